@@ -8,10 +8,9 @@
  * Copyright (c) 2024 Klaus Keppler - https://github.com/keppler/co2
  */
 
-#include <stddef.h>
-#include <util/delay.h>
 #include "SCD4x.h"
 #include "i2cmaster.h"
+#include "timer.h"
 
 #define SCD4x_ADDRESS ((0x62) << 1)
 
@@ -30,182 +29,242 @@
 #define SCD4x_COMMAND_POWER_DOWN                              0x36e0 // execution time: 1ms
 #define SCD4x_COMMAND_WAKE_UP                                 0x36f6 // execution time: 20ms
 #define SCD4x_COMMAND_PERSIST_SETTINGS                        0x3615 // execution time: 800ms
+#define SCD4x_COMMAND_REINIT                                  0x3646 // execution time: 30ms
+#define SCD4x_COMMAND_START_LOW_POWER_PERIODIC_MEASUREMENT   0x21ac // execution time: 0
+#define SCD4x_COMMAND_MEASURE_SINGLE_SHOT                     0x219d // execution time: 5000ms (SCD41 only)
+#define SCD4x_COMMAND_MEASURE_SINGLE_SHOT_RHT_ONLY            0x2196 // execution time: 50ms (SCD41 only)
 
 uint16_t SCD4x_VALUE_co2 = 0;
 int16_t SCD4x_VALUE_temp = 0;
 uint8_t SCD4x_VALUE_humidity = 0;
 
-static uint8_t _computeCRC8(const uint8_t *data, uint8_t len) {
-    uint8_t crc = 0xFF; // initialize with 0xff
+static uint8_t _rhtOnly = 0;    /* last measurement was RHT only: there's no CO₂ value */
 
-    for (uint8_t x = 0; x < len; x++) {
-        crc ^= data[x]; // XOR-in the next input byte
-        for (uint8_t i = 0; i < 8; i++) {
-            if ((crc & 0x80) != 0) {
-                crc = (uint8_t)((crc << 1) ^ 0x31);
-            } else {
-                crc <<= 1;
-            }
+/* Sensirion CRC-8 (polynomial 0x31, init 0xFF): one more byte */
+static uint8_t _crcByte(uint8_t crc, uint8_t data) {
+    crc ^= data; // XOR-in the next input byte
+    for (uint8_t i = 0; i < 8; i++) {
+        if ((crc & 0x80) != 0) {
+            crc = (uint8_t)((crc << 1) ^ 0x31);
+        } else {
+            crc <<= 1;
         }
     }
+    return crc;
+}
 
+/* CRC of a data word on the bus (MSB first) */
+static uint8_t _crcWord(uint16_t word) {
+    return _crcByte(_crcByte(0xFF, word >> 8), word & 0xFF);
+}
+
+/* also protects the log records (logger.c) */
+uint8_t SCD4x_computeCRC8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0xFF; // initialize with 0xff
+
+    for (uint8_t x = 0; x < len; x++) crc = _crcByte(crc, data[x]);
     return crc;
 }
 
-// Gets two bytes from SCD4x plus CRC.
-// Returns true if endTransmission returns zero _and_ the CRC check is valid
-static uint8_t _readRegister(uint16_t registerAddress, const uint16_t *data, uint8_t dataCount, uint16_t *response, uint8_t responseCount, uint16_t delayMillis) {
-    uint8_t buf[2];
+/* Commands are sent without waiting for their execution time; we only remember
+ * when the sensor will be ready again. The next command (or reading a response)
+ * waits for this deadline, so long running commands don't block the caller
+ * until it actually needs the sensor again. */
+static uint32_t _cmdStart = 0;      /* timer_millis() when the last command was sent */
+static uint16_t _cmdDuration = 0;   /* its execution time */
 
-    i2c_start_wait(SCD4x_ADDRESS + I2C_WRITE);
-    i2c_write(registerAddress >> 8);   // MSB
-    i2c_write(registerAddress & 0xFF); // LSB
+uint8_t SCD4x_busy(void) {
+    return timer_elapsed(_cmdStart) < _cmdDuration;
+}
 
-    // send data (if given)
-    for (uint8_t i=0; i < dataCount && data != NULL; i++) {
-        buf[0] = data[i] >> 8;      // MSB
-        buf[1] = data[i] & 0xFF;    // LSB
-        i2c_write(buf[0]);
-        i2c_write(buf[1]);
-        i2c_write(_computeCRC8(buf, 2)); // CRC
-    }
-    /* stopping in all cases, see line 87ff for full explanation */
-    i2c_stop();
+void SCD4x_wait(void) {
+    while (SCD4x_busy()) timer_sleep(0);
+}
 
-    while (delayMillis > 0) {
-        /* workaround against overflow on large delays (i.e. 10000ms on self test) */
-        uint16_t wait = delayMillis > 1000 ? 1000 : delayMillis;
-        _delay_ms(wait);
-        delayMillis -= wait;
-    }
+/* the argument word of a command, then the response words of the last transfer
+ * (static: the callers need no stack frame for them) */
+static uint16_t _words[3];
+
+/* Sends a command (unless 0) with _words[0] as argument word if argument is
+ * set, then reads responseCount words of its response (or of the last long
+ * running command) into _words. Every word is followed by its CRC. Returns
+ * zero if all CRCs are valid, else SCD4x_ERROR_CRC, or SCD4x_ERROR_BUS if the
+ * sensor didn't answer (the transfers are skipped once the bus has timed out). */
+static uint8_t _readRegister(uint16_t registerAddress, uint8_t argument, uint8_t responseCount, uint16_t delayMillis) {
+    uint8_t ret = 0;
 
-    if (response == NULL || responseCount == 0) {
-        return 0;
+    SCD4x_wait();
+    if (registerAddress != 0) {
+        i2c_start_wait(SCD4x_ADDRESS + I2C_WRITE);
+        i2c_write(registerAddress >> 8);   // MSB
+        i2c_write(registerAddress & 0xFF); // LSB
+        if (argument) {
+            i2c_write(_words[0] >> 8);      // MSB
+            i2c_write(_words[0] & 0xFF);    // LSB
+            i2c_write(_crcWord(_words[0]));
+        }
+        /* stopping in all cases, see below for full explanation */
+        i2c_stop();
+        if (i2c_timeout) return SCD4x_ERROR_BUS;
+
+        _cmdStart = timer_millis();
+        /* the millisecond counter may tick right after we've sent the command */
+        _cmdDuration = delayMillis > 0 ? delayMillis + 1 : 0;
+        if (responseCount == 0) return 0;
+        SCD4x_wait();
     }
 
-    uint8_t ret = 0;
     /* instead of i2c_rep_start(), we need to restart with i2c_start()... contrary to the SCD41 documentation,
      * the bus requires a full i2c_stop()/i2c_start() at least on very long requests like the self-test (10sec)
      * (for all "faster" commands the previous i2c_rep_start() would work though) */
-    i2c_start(SCD4x_ADDRESS + I2C_READ);
-    for (uint8_t i=0; i < responseCount; i++) {
-        buf[0] = i2c_readAck();
-        buf[1] = i2c_readAck();
-        response[i] = (buf[0] << 8) | buf[1];
-        uint8_t crc = i2c_read(i == responseCount-1 ? 0 : 1);   /* last read: NACK, else ACK */
-        if (crc != _computeCRC8(buf, 2)) ret = 1;
+    if (i2c_start(SCD4x_ADDRESS + I2C_READ) != 0) i2c_timeout = 1;   /* no answer: skip the reads */
+    for (uint16_t *word = _words; responseCount > 0; word++) {
+        *word = i2c_readAck() << 8;
+        *word |= i2c_readAck();
+        if ((--responseCount > 0 ? i2c_readAck() : i2c_readNak()) != _crcWord(*word)) ret = SCD4x_ERROR_CRC;  /* last read: NACK */
     }
     i2c_stop();
-    return ret;
+    return i2c_timeout ? SCD4x_ERROR_BUS : ret;
+}
+
+/* command without argument and response */
+static uint8_t _command(uint16_t registerAddress, uint16_t delayMillis) {
+    return _readRegister(registerAddress, 0, 0, delayMillis);
+}
+
+/* command with an argument word and without response */
+static void _commandArg(uint16_t registerAddress, uint16_t argument, uint16_t delayMillis) {
+    _words[0] = argument;
+    _readRegister(registerAddress, 1, 0, delayMillis);
+}
+
+/* single word response of a command (0: of the last long running one); error on a bus or CRC error */
+static uint16_t _readWord(uint16_t registerAddress, uint16_t error) {
+    return _readRegister(registerAddress, 0, 1, 1) != 0 ? error : _words[0];
+}
+
+/* single word response of the last (long running) command; 0xFFFF on error */
+uint16_t SCD4x_getResult(void) {
+    return _readWord(0, 0xFFFF);
 }
 
 uint8_t SCD4x_startPeriodicMeasurement(void) {
-    return _readRegister(SCD4x_COMMAND_START_PERIODIC_MEASUREMENT, NULL, 0, NULL, 0, 0);
+    _rhtOnly = 0;
+    return _command(SCD4x_COMMAND_START_PERIODIC_MEASUREMENT, 0);
+}
+
+/* one measurement every 30 seconds (instead of 5), at a fraction of the supply current */
+uint8_t SCD4x_startLowPowerPeriodicMeasurement(void) {
+    _rhtOnly = 0;
+    return _command(SCD4x_COMMAND_START_LOW_POWER_PERIODIC_MEASUREMENT, 0);
+}
+
+/* SCD41 only: one measurement (5s; 50ms for temperature and humidity only), the
+ * result is fetched with SCD4x_getData() afterwards; the sensor stays idle */
+void SCD4x_measureSingleShot(uint8_t rhtOnly) {
+    _rhtOnly = rhtOnly;
+    if (rhtOnly) {
+        _command(SCD4x_COMMAND_MEASURE_SINGLE_SHOT_RHT_ONLY, 50);
+    } else {
+        _command(SCD4x_COMMAND_MEASURE_SINGLE_SHOT, 5000);
+    }
 }
 
 uint8_t SCD4x_stopPeriodicMeasurement(void) {
-    return _readRegister(SCD4x_COMMAND_STOP_PERIODIC_MEASUREMENT, NULL, 0, NULL, 0, 500);
+    return _command(SCD4x_COMMAND_STOP_PERIODIC_MEASUREMENT, 500);
 }
 
 uint8_t SCD4x_getSerialNumber(uint8_t serial[6]) {
-    return _readRegister(SCD4x_COMMAND_GET_SERIAL_NUMBER, NULL, 0, (uint16_t*)serial, 3, 1);
+    uint8_t ret = _readRegister(SCD4x_COMMAND_GET_SERIAL_NUMBER, 0, 3, 1);
+    for (uint8_t i = 0; i < 6; i++) serial[i] = ((const uint8_t *)_words)[i];
+    return ret;
 }
 
 scd4x_sensor_type_t SCD4x_getSensorType(void) {
     /* use "GetFeatureSet" command to detect sensor type */
-    uint16_t featureSet;
-    if (_readRegister(SCD4x_COMMAND_GET_FEATURE_SET_VERSION, NULL, 0, &featureSet, 1, 1) != 0) {
+    if (_readRegister(SCD4x_COMMAND_GET_FEATURE_SET_VERSION, 0, 1, 1) != 0) {
         // error
         return SCD4x_SENSOR_ERROR;
     }
-    uint8_t sensor = ((featureSet & 0x1000) >> 12);
-    if (sensor == 0x00) return SCD4x_SENSOR_SCD40;
-    if (sensor == 0x01) return SCD4x_SENSOR_SCD41;
-    return SCD4x_SENSOR_UNKNOWN;
+    return (_words[0] & 0x1000) ? SCD4x_SENSOR_SCD41 : SCD4x_SENSOR_SCD40;
 }
 
 uint16_t SCD4x_getSensorAltitude(void) {
-    uint16_t data;
-    if (_readRegister(SCD4x_COMMAND_GET_SENSOR_ALTITUDE, NULL, 0, &data, 1, 1) != 0) {
-        /* error while reading */
-        return 9999;
-    }
-    return data;
+    return _readWord(SCD4x_COMMAND_GET_SENSOR_ALTITUDE, 9999);
 }
 
 void SCD4x_setSensorAltitude(uint16_t alt) {
-    _readRegister(SCD4x_COMMAND_SET_SENSOR_ALTITUDE, &alt, 1, NULL, 0, 1);
+    _commandArg(SCD4x_COMMAND_SET_SENSOR_ALTITUDE, alt, 1);
 }
 
 uint8_t SCD4x_getData(void) {
     uint8_t ret;
-    uint16_t data[3];
-    if ((ret = _readRegister(SCD4x_COMMAND_GET_DATA_READY_STATUS, NULL, 0, data, 1, 1)) != 0) {
+    if (SCD4x_busy()) return 0xFF;  /* still executing a command, don't wait for it */
+    if ((ret = _readRegister(SCD4x_COMMAND_GET_DATA_READY_STATUS, 0, 1, 1)) != 0) {
         /* error while reading */
         return ret;
     }
-    if ((data[0] & 0x07FF) == 0) return 0xFF; /* no data available */
+    if ((_words[0] & 0x07FF) == 0) return 0xFF; /* no data available */
 
     /* now read data */
-    if ((ret = _readRegister(SCD4x_COMMAND_READ_MEASUREMENT, NULL, 0, data, 3, 1)) != 0) {
+    if ((ret = _readRegister(SCD4x_COMMAND_READ_MEASUREMENT, 0, 3, 1)) != 0) {
         /* error while reading */
         return ret;
     }
 
-    SCD4x_VALUE_co2 = data[0];
-    SCD4x_VALUE_temp = ((int32_t)data[1] * 1750L / 65536L) - 450;
-    int32_t h = ((int32_t)data[2]) * 100L / 65536L;
-    if (h < 0) h = 0;
-    if (h > 100) h = 100;
-    SCD4x_VALUE_humidity = h;
+    if (!_rhtOnly) SCD4x_VALUE_co2 = _words[0];
+    /* T = -45 + 175 * raw / 2^16 (in 0.1°C: 1750 = 2^11 - 2^8 - 2^5 - 2^3 - 2^1),
+     * RH = 100 * raw / 2^16 (100 = 2^6 + 2^5 + 2^2, always 0..99): shifts and
+     * adds instead of the multiplication and division routines, same results */
+    uint32_t r = _words[1];
+    SCD4x_VALUE_temp = (int16_t)(((r << 11) - (r << 8) - (r << 5) - (r << 3) - (r << 1)) >> 16) - 450;
+    r = _words[2];
+    SCD4x_VALUE_humidity = ((r << 6) + (r << 5) + (r << 2)) >> 16;
 
     return 0;
 }
 
 scd4x_asc_enabled_t SCD4x_getAutomaticSelfCalibration(void) {
-    uint16_t data;
-    if (_readRegister(SCD4x_COMMAND_GET_AUTOMATIC_SELF_CALIBRATION, NULL, 0, &data, 1, 1) != 0) {
-        /* error while reading, i.e. CRC error */
-        return SCD4x_ASC_UNKNOWN;
-    }
-    switch (data) {
-        case 0x00: return SCD4x_ASC_DISABLED;
-        case 0x01: return SCD4x_ASC_ENABLED;
-        default: return SCD4x_ASC_UNKNOWN;
-    }
+    /* 0 or 1; anything else (e.g. 0xFFFF after a CRC error): unknown */
+    uint16_t data = _readWord(SCD4x_COMMAND_GET_AUTOMATIC_SELF_CALIBRATION, SCD4x_ASC_UNKNOWN);
+    return data > SCD4x_ASC_ENABLED ? SCD4x_ASC_UNKNOWN : (scd4x_asc_enabled_t)data;
 }
 
 void SCD4x_setAutomaticSelfCalibration(scd4x_asc_enabled_t asc) {
-    uint16_t data = asc == SCD4x_ASC_ENABLED ? 0x01 : 0x00;
-    _readRegister(SCD4x_COMMAND_SET_AUTOMATIC_SELF_CALIBRATION, &data, 1, NULL, 0, 1);
+    _commandArg(SCD4x_COMMAND_SET_AUTOMATIC_SELF_CALIBRATION, asc == SCD4x_ASC_ENABLED ? 0x01 : 0x00, 1);
+}
+
+void SCD4x_startForcedRecalibration(void) {
+    _commandArg(SCD4x_COMMAND_PERFORM_FORCED_RECALIBRATION, 420, 400);    // set to 420 ppm co2 -- see https://keelingcurve.ucsd.edu/
 }
 
 uint16_t SCD4x_performForcedRecalibration(void) {
-    uint16_t data = 420;    // set to 420 ppm co2 -- see https://keelingcurve.ucsd.edu/
-    if (_readRegister(SCD4x_COMMAND_PERFORM_FORCED_RECALIBRATION, &data, 1, &data, 1, 400) != 0) {
-        /* error while reading, i.e. CRC error */
-        return 0xFFFF;
-    }
-    return data;
+    SCD4x_startForcedRecalibration();
+    return SCD4x_getResult();
+}
+
+void SCD4x_startSelfTest(void) {
+    _command(SCD4x_COMMAND_PERFORM_SELF_TEST, 10000);
 }
 
 uint16_t SCD4x_performSelfTest(void) {
-    uint16_t data;
-    if (_readRegister(SCD4x_COMMAND_PERFORM_SELF_TEST, NULL, 0, &data, 1, 10000) != 0) {
-        /* error while reading, i.e. CRC error */
-        return 0xFFFF;
-    }
-    return data;
+    SCD4x_startSelfTest();
+    return SCD4x_getResult();
 }
 
 void SCD4x_powerDown(void) {
-    _readRegister(SCD4x_COMMAND_POWER_DOWN, NULL, 0, NULL, 0, 1);
+    _command(SCD4x_COMMAND_POWER_DOWN, 1);
 }
 
 void SCD4x_wakeUp(void) {
-    _readRegister(SCD4x_COMMAND_WAKE_UP, NULL, 0, NULL, 0, 20);
+    _command(SCD4x_COMMAND_WAKE_UP, 20);
 }
 
 void SCD4x_persistSettings(void) {
-    _readRegister(SCD4x_COMMAND_PERSIST_SETTINGS, NULL, 0, NULL, 0, 800);
+    _command(SCD4x_COMMAND_PERSIST_SETTINGS, 800);
+}
+
+/* reload the settings from the sensor's EEPROM (idle mode only) */
+void SCD4x_reinit(void) {
+    _command(SCD4x_COMMAND_REINIT, 30);
 }
@@ -26,11 +26,17 @@ typedef enum {
     SCD4x_ASC_UNKNOWN = 0xff
 } scd4x_asc_enabled_t;
 
+/* errors returned by the uint8_t functions (0: ok) */
+#define SCD4x_ERROR_CRC 0x01    /* response corrupted */
+#define SCD4x_ERROR_BUS 0x02    /* no answer, or the bus hung (see i2c_timeout) */
+
 extern uint16_t SCD4x_VALUE_co2;
 extern int16_t SCD4x_VALUE_temp;
 extern uint8_t SCD4x_VALUE_humidity;
 
 uint8_t SCD4x_startPeriodicMeasurement(void);
+uint8_t SCD4x_startLowPowerPeriodicMeasurement(void);
+void SCD4x_measureSingleShot(uint8_t rhtOnly);
 uint8_t SCD4x_stopPeriodicMeasurement(void);
 uint8_t SCD4x_getSerialNumber(uint8_t serial[6]);
 scd4x_sensor_type_t SCD4x_getSensorType(void);
@@ -41,8 +47,15 @@ scd4x_asc_enabled_t SCD4x_getAutomaticSelfCalibration(void);
 void SCD4x_setAutomaticSelfCalibration(scd4x_asc_enabled_t asc);
 uint16_t SCD4x_performForcedRecalibration(void);
 uint16_t SCD4x_performSelfTest(void);
+void SCD4x_startForcedRecalibration(void);
+void SCD4x_startSelfTest(void);
+uint16_t SCD4x_getResult(void);
+uint8_t SCD4x_busy(void);
+void SCD4x_wait(void);
 void SCD4x_powerDown(void);
 void SCD4x_wakeUp(void);
 void SCD4x_persistSettings(void);
+void SCD4x_reinit(void);
+uint8_t SCD4x_computeCRC8(const uint8_t *data, uint8_t len);
 
 #endif // _SCD4X_H
@@ -14,18 +14,17 @@
 #include "i2cmaster.h"
 #include "SSD1306.h"
 
-#if 0
+#ifdef FONT_PROGMEM
 // save font in flash
 #define FONT_MEM PROGMEM
-#define FONT_READ_BYTE pgm_read_byte
+#define FONT_READ_BLOCK memcpy_P
 #else
 // save font in EEPROM
 #define FONT_MEM EEMEM
-#define FONT_READ_BYTE eeprom_read_byte
+#define FONT_READ_BLOCK eeprom_read_block
 #endif
 
 #define I2CADDR     0x78
-#define WIRE_MAX    32
 
 #define SSD1306_MEMORYMODE          0x20 ///< See datasheet
 #define SSD1306_SEGREMAP            0xA0 ///< See datasheet
@@ -47,181 +46,132 @@
 #define SSD1306_COLUMNADDR          0x21 ///< See datasheet
 #define SSD1306_PAGEADDR            0x22 ///< See datasheet
 
-static const uint8_t FONT_MEM _font[][7] = {
-	{0x00,0x1C,0x3E,0x63,0x41,0x00,0x00},	// 0x28 (
-	{0x00,0x41,0x63,0x3E,0x1C,0x00,0x00},	// 0x29 )
-	// {0x08,0x2A,0x3E,0x1C,0x1C,0x3E,0x2A},	// 0x2A *
-	{0x0C,0x0C,0x0C,0x7F,0x3E,0x1C,0x08},	// 0x2A * => ▶  (we replace '*' with a nice pointer)
-	{0x08,0x08,0x3E,0x3E,0x08,0x08,0x00},	// 0x2B +
-	{0x00,0xA0,0xE0,0x60,0x00,0x00,0x00},	// 0x2C ,
-	{0x08,0x08,0x08,0x08,0x08,0x08,0x00},	// 0x2D -
-	{0x00,0x00,0x60,0x60,0x00,0x00,0x00},	// 0x2E .
-	{0x60,0x30,0x18,0x0C,0x06,0x03,0x01},	// 0x2F /
-	{0x3E,0x7F,0x59,0x4D,0x7F,0x3E,0x00},	// 0x30 0
-	{0x42,0x42,0x7F,0x7F,0x40,0x40,0x00},	// 0x31 1
-	{0x62,0x73,0x59,0x49,0x6F,0x66,0x00},	// 0x32 2
-	{0x22,0x63,0x49,0x49,0x7F,0x36,0x00},	// 0x33 3
-	{0x18,0x1C,0x16,0x13,0x7F,0x7F,0x10},	// 0x34 4
-	{0x27,0x67,0x45,0x45,0x7D,0x39,0x00},	// 0x35 5
-	{0x3C,0x7E,0x4B,0x49,0x79,0x30,0x00},	// 0x36 6
-	{0x03,0x63,0x71,0x19,0x0F,0x07,0x00},	// 0x37 7
-	{0x36,0x7F,0x49,0x49,0x7F,0x36,0x00},	// 0x38 8
-	{0x06,0x4F,0x49,0x69,0x3F,0x1E,0x00},	// 0x39 9
-	{0x00,0x00,0x6C,0x6C,0x00,0x00,0x00},	// 0x3A :
-	// {0x00,0xA0,0xEC,0x6C,0x00,0x00,0x00},	// 0x3B ;
-	{0x46,0x66,0x30,0x18,0x0C,0x66,0x62},	// 0x25 ; => % (replaced)
-	// {0x08,0x1C,0x36,0x63,0x41,0x00,0x00},	// 0x3C <
-	// {0x14,0x14,0x14,0x14,0x14,0x14,0x00},	// 0x3D =
-	// {0x00,0x41,0x63,0x36,0x1C,0x08,0x00},	// 0x3E >
-	{0x00,0x00,0x10,0x28,0x10,0x00,0x00},	// 0x3C < => animation
-	{0x00,0x38,0x44,0x44,0x44,0x38,0x00},	// 0x3D = => animation
-	{0x38,0x44,0x82,0x82,0x82,0x44,0x38},	// 0x3E > => animation
-	{0x02,0x03,0x51,0x59,0x0F,0x06,0x00},	// 0x3F ?
-	{0x00,0x00,0x00,0x00,0x00,0x00,0x00},	// 0x20 ' '
-	{0x7C,0x7E,0x13,0x13,0x7E,0x7C,0x00},	// 0x41 A
-	{0x41,0x7F,0x7F,0x49,0x49,0x7F,0x36},	// 0x42 B
-	{0x1C,0x3E,0x63,0x41,0x41,0x63,0x22},	// 0x43 C
-	{0x41,0x7F,0x7F,0x41,0x63,0x7F,0x1C},	// 0x44 D
-	{0x41,0x7F,0x7F,0x49,0x5D,0x41,0x63},	// 0x45 E
-	{0x41,0x7F,0x7F,0x49,0x1D,0x01,0x03},	// 0x46 F
-	{0x1C,0x3E,0x63,0x41,0x51,0x73,0x72},	// 0x47 G
-	{0x7F,0x7F,0x08,0x08,0x7F,0x7F,0x00},	// 0x48 H
-	{0x00,0x41,0x7F,0x7F,0x41,0x00,0x00},	// 0x49 I
-	{0x30,0x70,0x40,0x41,0x7F,0x3F,0x01},	// 0x4A J
-	{0x41,0x7F,0x7F,0x08,0x1C,0x77,0x63},	// 0x4B K
-	{0x41,0x7F,0x7F,0x41,0x40,0x60,0x70},	// 0x4C L
-	{0x7F,0x7F,0x06,0x0C,0x06,0x7F,0x7F},	// 0x4D M
-	{0x7F,0x7F,0x06,0x0C,0x18,0x7F,0x7F},	// 0x4E N
-	{0x1C,0x3E,0x63,0x41,0x63,0x3E,0x1C},	// 0x4F O
-	{0x41,0x7F,0x7F,0x49,0x09,0x0F,0x06},	// 0x50 P
-	{0x1E,0x3F,0x21,0x71,0x7F,0x5E,0x00},	// 0x51 Q
-	{0x41,0x7F,0x7F,0x19,0x39,0x6F,0x46},	// 0x52 R
-	{0x26,0x67,0x4D,0x59,0x7B,0x32,0x00},	// 0x53 S
-	{0x03,0x41,0x7F,0x7F,0x41,0x03,0x00},	// 0x54 T
-	{0x7F,0x7F,0x40,0x40,0x7F,0x7F,0x00},	// 0x55 U
-	{0x1F,0x3F,0x60,0x60,0x3F,0x1F,0x00},	// 0x56 V
-	{0x7F,0x7F,0x30,0x18,0x30,0x7F,0x7F},	// 0x57 W
-	{0x63,0x77,0x1C,0x08,0x1C,0x77,0x63},	// 0x58 X
-	{0x07,0x4F,0x78,0x78,0x4F,0x07,0x00},	// 0x59 Y
-	{0x67,0x73,0x59,0x4D,0x47,0x63,0x71},	// 0x5A Z
-	{0x00,0x06,0x09,0x09,0x06,0x00,0x00},	// 0x5B [ => °
+#include "font.h"	/* generated from font.txt (assets.py) */
+
+/* DOUBLE: a nibble with every bit doubled (one glyph column half) */
+static const uint8_t PROGMEM _double[16] = {
+	0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F, 0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF
 };
 
+/* The display didn't answer (e.g. broken cable): further transactions skip
+ * the bus until SSD1306_init() (retried from the main loop), so the
+ * measurement and the alarms go on without waiting for i2c_start_wait() to
+ * time out every time. */
+static uint8_t _offline;
+
+uint8_t SSD1306_offline(void) {
+	return _offline;
+}
+
+/* start a transaction with the control byte (0x00: commands, 0x40: data) */
+static void _SSD1306_start(uint8_t control) {
+	if (_offline) i2c_timeout = 1;	/* the writes up to i2c_stop() are skipped */
+	else _offline = i2c_start_wait(I2CADDR+I2C_WRITE);
+	i2c_write(control);
+}
+
+/* one byte from RAM (src 0), flash (1, as SSD1306_FLAG_PGM) or the EEPROM (2) */
+static uint8_t _SSD1306_read(const void *p, uint8_t src) {
+	if (src == 1) return pgm_read_byte(p);
+	if (src == 2) return eeprom_read_byte(p);
+	return *(const uint8_t *)p;
+}
+
 static void _SSD1306_command(const uint8_t c) {
-	i2c_start_wait(I2CADDR+I2C_WRITE);
-	i2c_write(0x00);	// Co = 0, D/C = 0
+	_SSD1306_start(0x00);	// Co = 0, D/C = 0
 	i2c_write(c);
 	i2c_stop();
 }
 
-static void _SSD1306_commandList(const uint8_t *c, uint8_t n, uint8_t fromFlash) {
-	i2c_start_wait(I2CADDR+I2C_WRITE);
-	i2c_write(0x00);
-	uint8_t bytesOut = 1;
-	while (n--) {
-		if (bytesOut >= WIRE_MAX) {
-			i2c_stop();
-			i2c_start_wait(I2CADDR+I2C_WRITE);
-			i2c_write(0x00);
-			bytesOut = 1;
-		}
-		i2c_write(fromFlash ? pgm_read_byte(c) : *c);
-		c++;
-		bytesOut++;
-	}
+/* set the address window (one command transaction) and start a data transaction;
+ * with horizontal addressing, data fills the window page by page */
+static void _SSD1306_window(uint8_t x0, uint8_t x1, uint8_t y0, uint8_t y1) {
+	_SSD1306_start(0x00);
+	i2c_write(SSD1306_COLUMNADDR);
+	i2c_write(x0);
+	i2c_write(x1);
+	i2c_write(SSD1306_PAGEADDR);
+	i2c_write(y0);
+	i2c_write(y1);
 	i2c_stop();
+	_SSD1306_start(0x40);
 }
 
 void SSD1306_writeImg(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t *img, uint8_t src) {
-	uint8_t ch;
-	uint8_t yPos;
-
-	for (yPos=0; yPos < height/8; yPos++) {
-		_SSD1306_command(SSD1306_COLUMNADDR);
-		_SSD1306_command(x * 8);
-		_SSD1306_command((x * 8) + width - 1);
-		_SSD1306_command(SSD1306_PAGEADDR);
-		_SSD1306_command(yPos + y);
-		_SSD1306_command(yPos + y);
-
-		i2c_start(I2CADDR+I2C_WRITE);
-		i2c_write(0x40);
-		uint8_t xPos;
-		for (xPos=0; xPos < width; xPos++) {
-			ch = src == 1 ? pgm_read_byte(img + (yPos * width) + xPos) : (src == 2 ? eeprom_read_byte(img + (yPos * width) + xPos) : img[(yPos * width) + xPos]);
-			i2c_write(ch);
+	/* one window and one data transaction, filled page by page */
+	_SSD1306_window(x * 8, (x * 8) + width - 1, y, y + (height / 8) - 1);
+	for (uint8_t page = height / 8; page > 0; page--) {
+		for (uint8_t column = width; column > 0; column--) {
+			i2c_write(_SSD1306_read(img++, src));
 		}
-		i2c_stop();
 	}
+	i2c_stop();
 }
 
-void SSD1306_writeChar(uint8_t x, uint8_t y, uint8_t ch, uint8_t flags) {
-
-	if (x > 15 || y > 7) return;	/* check if we're within our boundaries */
+/* map a character to its index in _font */
+static uint8_t _SSD1306_glyph(uint8_t ch) {
 	if (ch == ' ') ch = '@';		/* map ' ' to '@' */
 	else if (ch == '%') ch = ';';	/* map '%' to ';' */
 
 	if (ch < '(' || ch > '^') ch = '@';
-	ch -= '(';
-
-    uint8_t loop;
-    for (loop = 0; loop == 0 || (loop == 1 && (flags & SSD1306_FLAG_DOUBLE)); loop++) {
-        /* it's actually much more compact to send these commands one by one than
-         * building an array and sending them using commandList */
-        _SSD1306_command(SSD1306_COLUMNADDR);
-        _SSD1306_command(x * 8);
-        _SSD1306_command(((x + (flags & SSD1306_FLAG_DOUBLE ? 2 : 1)) * 8) - 1);
-        _SSD1306_command(SSD1306_PAGEADDR);
-        _SSD1306_command(y + loop);
-        _SSD1306_command(y + loop);
-
-        i2c_start_wait(I2CADDR + I2C_WRITE);
-        i2c_write(0x40);
-        for (uint8_t line = 0; line < 7; ++line) {
-            uint8_t c = (flags & SSD1306_FLAG_INVERTED) ? FONT_READ_BYTE(&_font[ch][line]) ^ 0xFF : FONT_READ_BYTE(
-                    &_font[ch][line]);
-            if (loop == 1) {
-                c = ((c & 0x10) >> 4) | ((c & 0x10) >> 3) | ((c & 0x20) >> 3) | ((c & 0x20) >> 2) | ((c & 0x40) >> 2) |
-                    ((c & 0x40) >> 1) | ((c & 0x80) >> 1) | (c & 0x80);
-            } else if (flags & SSD1306_FLAG_DOUBLE) {
-                c = (c & 0x01) | ((c & 0x01) << 1) | ((c & 0x02) << 1) | ((c & 0x02) << 2) | ((c & 0x04) << 2) |
-                    ((c & 0x04) << 3) | ((c & 0x08) << 3) | ((c & 0x08) << 4);
-            }
-        	i2c_write(flags & SSD1306_FLAG_LIGHT ? c & 0xAA : c);
-        	if (flags & SSD1306_FLAG_DOUBLE) i2c_write(flags & SSD1306_FLAG_LIGHT ? c & 0x55 : c);
-        }
-        i2c_write((flags & SSD1306_FLAG_INVERTED) ? 0xFF : 0x00);
-        if (flags & SSD1306_FLAG_DOUBLE) i2c_write((flags & SSD1306_FLAG_INVERTED) ? 0xFF : 0x00);
-        i2c_stop();
-    }
+	return ch - '(';
 }
 
-uint8_t SSD1306_writeString(uint8_t x, uint8_t y, const char *str, uint8_t flags) {
-	uint8_t ch;
-	while ((ch = (flags & SSD1306_FLAG_PGM) ? pgm_read_byte(str++) : *str++) != '\0') {
-		SSD1306_writeChar(x, y, ch, flags & ~(SSD1306_FLAG_PGM));
-        x++;
-        if (flags & SSD1306_FLAG_DOUBLE) x++;
+/* send the 8 columns of glyph g (16 for DOUBLE; loop 0: upper half, loop 1: lower half) */
+static void _SSD1306_glyphData(uint8_t g, uint8_t flags, uint8_t loop) {
+	static uint8_t glyph[sizeof(_font[0]) + 1];
+	uint8_t invert = (flags & SSD1306_FLAG_INVERTED) ? 0xFF : 0x00;
+
+	FONT_READ_BLOCK(glyph, _font[g], sizeof(_font[0]));	/* one block read instead of a call per byte */
+	glyph[sizeof(_font[0])] = 0x00;	/* spacing */
+	for (uint8_t line = 0; line < sizeof(glyph); ++line) {
+		uint8_t c = glyph[line] ^ invert;
+		if (flags & SSD1306_FLAG_DOUBLE) c = pgm_read_byte(&_double[loop ? c >> 4 : c & 0x0F]);
+		i2c_write(flags & SSD1306_FLAG_LIGHT ? c & 0xAA : c);
+		if (flags & SSD1306_FLAG_DOUBLE) i2c_write(flags & SSD1306_FLAG_LIGHT ? c & 0x55 : c);
 	}
-	return(x);
 }
 
-void SSD1306_clear(void) {
-	/* clear display */
-	_SSD1306_command(SSD1306_COLUMNADDR);
-	_SSD1306_command(0x00);
-	_SSD1306_command(0x7F);
-	_SSD1306_command(SSD1306_PAGEADDR);
-	_SSD1306_command(0x00);
-	_SSD1306_command(0x07);
-	for (uint8_t line = 64; line > 0; line--) {
-		i2c_start_wait(I2CADDR+I2C_WRITE);
-		i2c_write(0x40);
-		for (uint8_t column = 0; column < 16; ++column) {
-			i2c_write(0x00);
+void SSD1306_writeChar(uint8_t x, uint8_t y, uint8_t ch, uint8_t flags) {
+	static char str[2];	/* static: no stack frame needed */
+	str[0] = ch;
+	SSD1306_writeString(x, y, str, flags & ~(SSD1306_FLAG_PGM));
+}
+
+/* The whole string is sent with one address window and one data transaction
+ * (for DOUBLE: all upper halves, then all lower halves, as the window wraps
+ * to the next page); characters beyond the right edge are skipped. */
+uint8_t SSD1306_writeString(uint8_t x, uint8_t y, const char *str, uint8_t flags) {
+	uint8_t w = (flags & SSD1306_FLAG_DOUBLE) ? 2 : 1;
+	uint8_t end = x, n = 0;
+
+	while (end + w <= 16 && _SSD1306_read(str + n, flags & SSD1306_FLAG_PGM) != '\0') {
+		n++;
+		end += w;
+	}
+	if (n == 0 || y + w > 8) return(end);
+
+	_SSD1306_window(x * 8, end * 8 - 1, y, y + w - 1);
+	for (uint8_t loop = 0; loop < w; loop++) {
+		for (uint8_t i = 0; i < n; i++) {
+			_SSD1306_glyphData(_SSD1306_glyph(_SSD1306_read(str + i, flags & SSD1306_FLAG_PGM)), flags, loop);
 		}
-		i2c_stop();
 	}
+	i2c_stop();
+	return(end);
+}
+
+/* clear the rows (pages) y0 to y1 as one window and one data transaction */
+void SSD1306_clearRows(uint8_t y0, uint8_t y1) {
+	_SSD1306_window(0x00, 0x7F, y0, y1);
+	for (uint8_t page = y0; page <= y1; page++) {
+		for (uint8_t column = 128; column > 0; column--) i2c_write(0x00);
+	}
+	i2c_stop();
+}
+
+void SSD1306_clear(void) {
+	SSD1306_clearRows(0, 7);
 }
 
 void SSD1306_on(void) {
@@ -232,8 +182,16 @@ void SSD1306_off(void) {
 	_SSD1306_command(SSD1306_DISPLAYOFF);
 }
 
+void SSD1306_contrast(uint8_t contrast) {
+	_SSD1306_start(0x00);
+	i2c_write(SSD1306_SETCONTRAST);
+	i2c_write(contrast);
+	i2c_stop();
+}
+
 
-void SSD1306_init(void) {
+/* returns non-zero if the display doesn't answer */
+uint8_t SSD1306_init(void) {
 	static const uint8_t PROGMEM cmds[] = {
 		SSD1306_DISPLAYOFF,
 		SSD1306_SETDISPLAYCLOCKDIV,
@@ -252,7 +210,7 @@ void SSD1306_init(void) {
 		SSD1306_SETCOMPINS,
 		0x12,
 		SSD1306_SETCONTRAST,
-		0xCF,
+		SSD1306_CONTRAST,
 		SSD1306_SETPRECHARGE,
 		0xF1,
 		SSD1306_SETVCOMDETECT,
@@ -261,38 +219,39 @@ void SSD1306_init(void) {
 		SSD1306_NORMALDISPLAY
 	};
 
-	_SSD1306_commandList(cmds, sizeof(cmds), 1);
+	_offline = 0;
+	_SSD1306_start(0x00);
+	for (uint8_t i = 0; i < sizeof(cmds); i++) i2c_write(pgm_read_byte(&cmds[i]));
+	i2c_stop();
+	return _offline;
 }
 
-/**
- * C++ version 0.4 char* style "itoa":
- * Written by Lukás Chmela
- * Released under GPLv3.
- */
-uint8_t SSD1306_writeInt(uint8_t x, uint8_t y, int32_t value, uint8_t base, uint8_t flags, uint8_t len) {
-	static const char PROGMEM data[] = "ZYXWVUTSRQPONMLKJIHGFEDCBA9876543210123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-	char result[17];
-	if (base < 2 || base > 36 || len > 16) return(x);
+/* any base from 2 to 36, right-aligned to len characters (at most 16); each
+ * digit is the remainder of a shift-and-subtract division by base, so
+ * neither a table nor the division routines are needed (16 bits: every
+ * value on the display fits, the sign is up to the caller) */
+uint8_t SSD1306_writeInt(uint8_t x, uint8_t y, uint16_t value, uint8_t base, uint8_t flags, uint8_t len) {
+	static char result[17];	/* 16 binary digits (static: no stack frame needed) */
+	char *ptr = result + sizeof(result) - 1;
 
-	char *ptr = result, *ptr1 = result, tmp_char;
-	int32_t tmp_value;
+	if (base < 2 || base > 36 || len > 16) return(x);
 
+	*ptr = '\0';
 	do {
-		tmp_value = value;
-		value /= base;
-		*ptr++ = pgm_read_byte(data + (35 + (tmp_value - value * base)));
+		uint8_t rem = 0;
+		for (uint8_t bit = 16; bit > 0; bit--) {
+			rem = (rem << 1) | (value >> 15);
+			value <<= 1;
+			if (rem >= base) {
+				rem -= base;
+				value |= 1;
+			}
+		}
+		*--ptr = rem < 10 ? '0' + rem : 'A' - 10 + rem;
 	} while (value);
 
-	if (tmp_value < 0) *ptr++ = '-';
-
-    while (ptr - result < len) *ptr++ = (flags & SSD1306_FLAG_FILL_ZERO) ? '0' : ' ';
-
-    *ptr-- = '\0';
-	while (ptr1 < ptr) {
-		tmp_char = *ptr;
-		*ptr--= *ptr1;
-		*ptr1++ = tmp_char;
-	}
+	char fill = (flags & SSD1306_FLAG_FILL_ZERO) ? '0' : ' ';
+	while (ptr > result + sizeof(result) - 1 - len) *--ptr = fill;
 
-	return(SSD1306_writeString(x, y, result, flags & ~(SSD1306_FLAG_PGM)));
+	return(SSD1306_writeString(x, y, ptr, flags & ~(SSD1306_FLAG_PGM)));
 }
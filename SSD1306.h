@@ -15,13 +15,18 @@
 #define SSD1306_FLAG_FILL_ZERO 0x08
 #define SSD1306_FLAG_LIGHT     0x10
 
-void SSD1306_init(void);
+#define SSD1306_CONTRAST       0xCF /* set by SSD1306_init() */
+
+uint8_t SSD1306_init(void);  /* non-zero: display not answering (skipped until the next init) */
+uint8_t SSD1306_offline(void);  /* non-zero: the display stopped answering, SSD1306_init() retries */
 void SSD1306_writeImg(uint8_t x, uint8_t y, uint8_t width, uint8_t height, const uint8_t *img, uint8_t src); /* src: 0=mem, 1=pgm, 2=eeprom */
 void SSD1306_writeChar(uint8_t x, uint8_t y, uint8_t ch, uint8_t flags);
 uint8_t SSD1306_writeString(uint8_t x, uint8_t y, const char *str, uint8_t flags);
 void SSD1306_clear(void);
+void SSD1306_clearRows(uint8_t y0, uint8_t y1);
 void SSD1306_on(void);
-void SSD1306_off(void);
-uint8_t SSD1306_writeInt(uint8_t x, uint8_t y, int32_t value, uint8_t base, uint8_t flags, uint8_t len);
+void SSD1306_off(void);     /* the display keeps its RAM and can still be written */
+void SSD1306_contrast(uint8_t contrast);
+uint8_t SSD1306_writeInt(uint8_t x, uint8_t y, uint16_t value, uint8_t base, uint8_t flags, uint8_t len); /* base 2..36, unsigned */
 
 #endif /* !_SSD1306_H */
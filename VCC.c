@@ -7,7 +7,7 @@
  */
 
 #include <avr/io.h>
-#include <util/delay.h>
+#include "timer.h"
 #include "VCC.h"
 
 /*
@@ -21,8 +21,9 @@ uint16_t VCC_get(void) {
     /* By default, the successive approximation circuitry requires an input clock frequency between 50
      * kHz and 200 kHz to get maximum resolution. */
 
-    /* Enable ADC, set prescaler to /8 which will give an ADC clock of 1mHz/8 = 125kHz */
-    ADCSRA = _BV(ADEN) | _BV(ADPS1) | _BV(ADPS0);
+    /* Enable ADC, set prescaler to /8 which will give an ADC clock of 1mHz/8 = 125kHz
+     * (the CPU runs at F_CPU_FAST here: /64 at 8MHz) */
+    ADCSRA = _BV(ADEN) | (3 + TIMER_CLOCK_SHIFT);
 
     /* Select ADC inputs
      * BITS:  76543210
@@ -33,7 +34,7 @@ uint16_t VCC_get(void) {
     /* After switching to internal voltage reference the ADC requires a settling time of 1ms before
      * measurements are stable. Conversions starting before this may not be reliable. The ADC must
      * be enabled during the settling time. */
-    _delay_ms(1);
+    timer_delay(1);
                 
     /* The first conversion after switching voltage source may be inaccurate, and the user is advised to discard this result. */
     ADCSRA |= _BV(ADSC);             /* start a conversion */
@@ -52,8 +53,18 @@ uint16_t VCC_get(void) {
     /* Compute a fixed point with 2 decimal places (i.e. 5v= 500)
      * Vcc    =  (1.10v * 1024) / ADC
      * Vcc100 = ((1.10v * 1024) / ADC ) * 100  ->convert to 2 decimal fixed point
-     * Vcc100 = ((110   * 1024) / ADC )        ->simplify to all 16-bit integer math */
-    uint16_t vccx100 = (uint16_t) ( (110L * 1024L) / adc);
+     * Vcc100 = ((110   * 1024) / ADC )        ->simplify to all 16-bit integer math
+     * as a long division: the 10 bits of the factor 1024 shifted in one by one, the
+     * remainder stays below ADC (110 < ADC for any Vcc below 10V) */
+    uint16_t rem = 110, vccx100 = 0;
+    for (uint8_t i = 0; i < 10; i++) {
+        rem <<= 1;
+        vccx100 <<= 1;
+        if (rem >= adc) {
+            rem -= adc;
+            vccx100 |= 1;
+        }
+    }
     
     /* Note that the ADC will not automatically be turned off when entering other sleep modes than Idle
      * mode and ADC Noise Reduction mode. The user is advised to write zero to ADEN before entering such
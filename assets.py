@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#         ___    ___
+#  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+# / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+#_\__\___/___|  |___/\___|_||_/__/\___/_|__________________________________
+# CO₂ Sensor for Caving -- https://github.com/keppler/co2
+#
+# Build step: generate the display tables from their sources
+#   font.txt   -> font.h    glyph columns for SSD1306.c, 7 bytes per glyph
+#   splash.png -> splash.h  splash image for main.c, in display memory layout
+#
+# Usage: assets.py SOURCE_DIR OUTPUT_DIR (called by CMake, Python 3 only)
+#
+# Both tables stay uncompressed in the EEPROM (364 + 138 of its 512 bytes).
+# Compression would save EEPROM, which isn't short, and cost flash for the
+# decoder, which is: an RLE splash saved 36 bytes of EEPROM for a decoder
+# of about 100 bytes of flash. Characters are drawn in random order from the hot path, and any font
+# scheme with random access (column dictionary, trimmed glyphs) needs an
+# index that costs about as much as it saves. The sizes are printed for
+# comparison.
+
+import os
+import struct
+import sys
+import zlib
+
+FONT_FIRST = 0x28
+FONT_WIDTH = 7
+
+
+def banner(what):
+    return ("/*         ___    ___\n"
+            " *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _\n"
+            " * / _/ _ \\/ /___\\__ \\/ -_) ' \\(_-</ _ \\ '_|\n"
+            " *_\\__\\___/___|  |___/\\___|_||_/__/\\___/_|_________________________________\n"
+            " * CO₂ Sensor for Caving -- https://github.com/keppler/co2\n"
+            " * %s\n"
+            " * Generated by assets.py, do not edit.\n"
+            " */\n" % what)
+
+
+def hex_lines(data, indent="    ", per_line=16):
+    return ",\n".join(indent + ", ".join("0x%02x" % b for b in data[i:i + per_line])
+                      for i in range(0, len(data), per_line))
+
+
+def read_png(path):
+    """Palette or grayscale PNG with 1 bit per pixel: rows of 0/1 values (1 = palette index 1 / black)"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        sys.exit("%s: not a PNG file" % path)
+    pos, idat = 8, b""
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        chunk = data[pos + 8:pos + 8 + length]
+        if kind == b"IHDR":
+            width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", chunk)
+        elif kind == b"IDAT":
+            idat += chunk
+        pos += 12 + length
+    if depth != 1 or color not in (0, 3) or interlace != 0:
+        sys.exit("%s: 1 bit per pixel (palette or grayscale), not interlaced required" % path)
+    raw = zlib.decompress(idat)
+    stride = (width + 7) // 8
+    rows, prev = [], bytearray(stride)
+    for y in range(height):
+        kind = raw[y * (stride + 1)]
+        line = bytearray(raw[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for x in range(stride):
+            # filters with 1 byte per "pixel" for a bit depth below 8
+            left = line[x - 1] if x > 0 else 0
+            up_left = prev[x - 1] if x > 0 else 0
+            if kind == 1:
+                line[x] = (line[x] + left) & 0xFF
+            elif kind == 2:
+                line[x] = (line[x] + prev[x]) & 0xFF
+            elif kind == 3:
+                line[x] = (line[x] + (left + prev[x]) // 2) & 0xFF
+            elif kind == 4:
+                p = left + prev[x] - up_left
+                pa, pb, pc = abs(p - left), abs(p - prev[x]), abs(p - up_left)
+                line[x] = (line[x] + (left if pa <= pb and pa <= pc else prev[x] if pb <= pc else up_left)) & 0xFF
+        bits = [(line[x >> 3] >> (7 - (x & 7))) & 1 for x in range(width)]
+        # grayscale: 0 is black
+        rows.append(bits if color == 3 else [1 - b for b in bits])
+        prev = line
+    return width, height, rows
+
+
+def pages(width, height, rows):
+    """display memory layout: 8 rows per page, one byte per column (LSB on top)"""
+    if height % 8:
+        sys.exit("image height must be a multiple of 8")
+    return [sum(rows[page * 8 + bit][x] << bit for bit in range(8))
+            for page in range(height // 8) for x in range(width)]
+
+
+def read_font(path):
+    """glyphs from font.txt: [(comment, columns)]"""
+    glyphs, header, bitmap = [], None, []
+    with open(path, encoding="utf-8") as f:
+        lines = [line.rstrip("\n") for line in f] + [""]
+    for number, line in enumerate(lines, 1):
+        if header is None:
+            # comments only between glyphs (rows start with '#' as well)
+            if line.strip() and not line.startswith("#"):
+                header = line.strip()
+                code = int(header.split()[0], 16)
+                if code != FONT_FIRST + len(glyphs):
+                    sys.exit("%s:%d: expected glyph 0x%02X" % (path, number, FONT_FIRST + len(glyphs)))
+            continue
+        if line.strip():
+            if len(line) != FONT_WIDTH or set(line) - set("#."):
+                sys.exit("%s:%d: %d pixels ('#' or '.') expected" % (path, number, FONT_WIDTH))
+            bitmap.append(line)
+            continue
+        if len(bitmap) != 8:
+            sys.exit("%s:%d: 8 rows per glyph expected" % (path, number))
+        glyphs.append((header, [sum((bitmap[row][x] == "#") << row for row in range(8)) for x in range(FONT_WIDTH)]))
+        header, bitmap = None, []
+    return glyphs
+
+
+def font_report(glyphs):
+    columns = [c for _, g in glyphs for c in g]
+    unique = len(set(columns))
+    trimmed = sum(len(bytes(g).rstrip(b"\0")) for _, g in glyphs)
+    print("font: %d glyphs, %d bytes; column dictionary %d + %d bytes, trimmed %d + %d bytes index"
+          % (len(glyphs), len(columns), unique, len(columns), trimmed, len(glyphs)))
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("Usage: %s SOURCE_DIR OUTPUT_DIR" % sys.argv[0])
+    source, output = sys.argv[1:]
+
+    glyphs = read_font(os.path.join(source, "font.txt"))
+    font_report(glyphs)
+    with open(os.path.join(output, "font.h"), "w", encoding="utf-8") as f:
+        f.write(banner("Display font (from font.txt), included by SSD1306.c"))
+        f.write("\nstatic const uint8_t FONT_MEM _font[][%d] = {\n" % FONT_WIDTH)
+        for header, columns in glyphs:
+            f.write("\t{%s},\t// %s\n" % (",".join("0x%02X" % c for c in columns), header))
+        f.write("};\n")
+
+    width, height, rows = read_png(os.path.join(source, "splash.png"))
+    data = pages(width, height, rows)
+    print("splash: %dx%d, %d bytes" % (width, height, len(data)))
+    with open(os.path.join(output, "splash.h"), "w", encoding="utf-8") as f:
+        f.write(banner("Splash screen (from splash.png), in the EEPROM: SSD1306_writeImg(..., 2)"))
+        f.write("\n#ifndef _SPLASH_H\n#define _SPLASH_H\n\n#include <stdint.h>\n#include <avr/eeprom.h>\n\n")
+        f.write("#define splash_width  %d\n#define splash_height %d\n\n" % (width, height))
+        f.write("const uint8_t EEMEM splash_data[] = {\n%s\n};\n" % hex_lines(data))
+        f.write("\n#endif /* _SPLASH_H */\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -12,8 +12,9 @@ echo "AVR-Size tool: ${AVRSIZE}"
 
 # Usage
 if test $# -lt 1; then
-	echo "Usage: avr-mem.sh <ELF file> [<AVR device name>]" >&2
+	echo "Usage: avr-mem.sh <ELF file> [<AVR device name> [<flash limit>]]" >&2
 	echo "Prints sizes of the different AVR memory spaces in an ELF file." >&2
+	echo "Exits non-zero if the program is larger than the flash limit (bytes)." >&2
 	exit 1
 fi
 
@@ -109,7 +110,7 @@ esac
 
 
 ${AVRSIZE} -A "$1" | ${AWK} -v progmax=${PROGMAX} -v \
-datamax=${DATAMAX} -v eeprommax=${EEPROMMAX} -v device=$2 -- '
+datamax=${DATAMAX} -v eeprommax=${EEPROMMAX} -v device=$2 -v proglimit=${3:-0} -- '
 /^\.(text|data|bootloader) / {text += $2}
 /^\.(data|bss|noinit) / {data += $2}
 /^\.(eeprom) / {eeprom += $2}
@@ -153,4 +154,9 @@ END {
         }
         print "(.eeprom)\n"
     }
+    if (proglimit > 0 && text > proglimit)
+    {
+        printf "Program is %d bytes larger than the limit of %d bytes\n", text - proglimit, proglimit;
+        exit 1
+    }
 }'
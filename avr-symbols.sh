@@ -0,0 +1,84 @@
+#! /bin/sh
+#         ___    ___
+#  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+# / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+#_\__\___/___|  |___/\___|_||_/__/\___/_|__________________________________
+# CO₂ Sensor for Caving -- https://github.com/keppler/co2
+#
+# Per-symbol memory usage of the firmware (targets "size" and "size-baseline")
+#
+# The input is the symbol table written by the build before the ELF file is
+# stripped ("avr-nm -S --size-sort"). Symbols are assigned to the memory
+# spaces by their address: text (flash: code and PROGMEM constants), data
+# (RAM, initialized from flash), bss (RAM) and eeprom.
+#
+# Without a baseline, prints "<space> <bytes> <symbol>" lines, the format of
+# size-baseline.txt. With a baseline, prints every symbol with its change
+# (new symbols are marked "+", removed ones "-") and the totals per space.
+
+AWK="${AWK:-awk}"
+
+if test $# -lt 1; then
+	echo "Usage: avr-symbols.sh <symbol table> [<baseline>]" >&2
+	exit 1
+fi
+
+table() {
+	${AWK} '
+	function hex(s,  i, n) {
+		s = tolower(s)
+		for (i = 1; i <= length(s); i++) n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+		return n
+	}
+	NF >= 4 {
+		addr = hex($1); size = hex($2)
+		if (addr >= 8454144) space = "eeprom"		# 0x810000
+		else if (addr >= 8388608) space = ($3 ~ /^[bB]$/) ? "bss" : "data"	# 0x800000
+		else space = "text"
+		printf "%s %d %s\n", space, size, $4
+	}' "$1" | sort -k1,1 -k2,2nr -k3,3
+}
+
+if test $# -lt 2; then
+	table "$1"
+	exit 0
+fi
+
+if test ! -f "$2"; then
+	echo "no baseline $2 yet (create it with the size-baseline target)"
+fi
+
+table "$1" | ${AWK} -v baseline="$2" '
+BEGIN {
+	while ((getline line < baseline) > 0) {
+		if (line ~ /^#/) continue	# comment (e.g. where the baseline came from)
+		split(line, f, " ")
+		base[f[1] " " f[3]] = f[2]
+		btotal[f[1]] += f[2]
+		have = 1
+	}
+}
+{
+	key = $1 " " $3
+	total[$1] += $2
+	if (!have) mark = ""
+	else if (!(key in base)) mark = "+"
+	else if (base[key] != $2) mark = sprintf("%+d", $2 - base[key])
+	else mark = ""
+	printf "%-6s %6d %6s  %s\n", $1, $2, mark, $3
+	seen[key] = 1
+}
+END {
+	for (key in base) {
+		if (key in seen) continue
+		split(key, k, " ")
+		printf "%-6s %6d %6s  %s\n", k[1], 0, "-" base[key], k[2]
+	}
+	split("text data bss eeprom", spaces, " ")
+	for (i = 1; i <= 4; i++) {
+		s = spaces[i]
+		printf "total  %-6s %6d", s, total[s]
+		if (have) printf " (%+d)", total[s] - btotal[s]
+		printf "\n"
+	}
+}'
@@ -4,24 +4,130 @@
  *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
  * CO₂ Sensor for Caving -- https://github.com/keppler/co2
  * Driver for sound transducer
+ * Melodies are played in the background: beep() only queues them, the
+ * Timer1 overflow interrupt steps through the notes.
+ * In logger builds the same interrupt sends data bytes as FSK tones (see
+ * beep_send()): 1000 baud, each byte as start bit (0), 8 data bits (least
+ * significant first) and stop bit (1), a pause between bytes is a 1. Both
+ * tones fill a bit with whole periods: 1 = 5 x 200us (5kHz), 0 = 4 x 250us
+ * (4kHz), close to the resonance of the transducer.
  */
 
 #include <stdint.h>
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
-#include <util/delay.h>
 #include "beep.h"
+#include "timer.h"
+
+#define BEEP_QUEUE  16                  /* queued melodies (power of 2), the 4x alarm takes 8 */
+#define BEEP_TICK   (F_CPU / 100)       /* timer1 cycles per note length unit (10ms), timer1 counts at F_CPU */
+
+#define FSK_QUEUE           16                  /* queued bytes (power of 2) */
+#define FSK_MARK_TOP        (F_CPU / 5000 - 1)  /* 1: 5kHz ... */
+#define FSK_MARK_PERIODS    5                   /* ... for 1ms */
+#define FSK_SPACE_TOP       (F_CPU / 4000 - 1)  /* 0: 4kHz ... */
+#define FSK_SPACE_PERIODS   4                   /* ... for 1ms */
+#if FSK_SPACE_TOP > 255
+    #error F_CPU too high for the FSK tones
+#endif
+#if BEEP_TICK + 256 > 0xFFFF
+    #error F_CPU too high for the 16 bit note length counter
+#endif
 
 uint8_t beep_volume = 3;
 
 static const uint8_t melody[] PROGMEM = {
-    6, 8, 12, 16, 30, 44,  /* index to melodies */
+    7, 9, 13, 17, 31, 45, 47,   /* index to melodies */
     250, 10,               /* short */
     220, 30, 250, 15,      /* relax */
     250, 15, 220, 30,      /* warn */
     250, 20, 220, 14, 190, 14, 0, 6, 250, 6, 0, 6, 250, 6,   /* startup */
-    190, 20, 220, 14, 250, 14, 0, 6, 250, 6, 0, 6, 250, 6    /* shutdown */
+    190, 20, 220, 14, 250, 14, 0, 6, 250, 6, 0, 6, 250, 6,   /* shutdown */
+    0, 20                  /* pause */
 };
 
+static volatile uint8_t _queue[BEEP_QUEUE];
+static volatile uint8_t _head = 0, _tail = 0;   /* next melody to play, next free slot */
+static uint8_t _pos = 0, _end = 0;              /* current note / end of current melody */
+static uint8_t _len;                            /* remaining length of current note */
+static uint16_t _acc;                           /* timer1 cycles since last length unit */
+
+#ifdef LOGGER
+static volatile uint8_t _fskQueue[FSK_QUEUE];
+static volatile uint8_t _fskHead = 0, _fskTail = 0;
+static uint16_t _fskFrame = 0;                  /* bits left to send above a marker bit, 0: playing melodies */
+#endif
+
+static void _beep_stop(void) {
+    TIMSK &= ~(1 << TOIE1);
+    TCCR1 = 0;
+    GTCCR = 0;
+}
+
+/* load the next note (or the next queued melody); stop timer1 if nothing is left */
+static void _beep_next(void) {
+    while (_pos >= _end) {
+        if (_head == _tail) {
+            _beep_stop();
+            return;
+        }
+        uint8_t t = _queue[_head];
+        _head = (_head + 1) & (BEEP_QUEUE - 1);
+        _pos = pgm_read_byte(melody + t);
+        _end = pgm_read_byte(melody + t + 1);
+    }
+
+    uint8_t tmp = pgm_read_byte(melody + _pos);
+    if (tmp == 0) {
+        /* pause: disconnect OC1B, keep a sane TOP so the interrupt rate stays low */
+        OCR1C = 0xFF;
+        GTCCR = 1 << PWM1B;
+    } else {
+        OCR1C = tmp;
+        OCR1B = tmp >> beep_volume;
+        GTCCR = 1 << PWM1B | 1 << COM1B1;
+    }
+    _len = pgm_read_byte(melody + _pos + 1);
+    _pos += 2;
+}
+
+#ifdef LOGGER
+/* load the tone of the next bit (or the next queued byte); stop timer1 if nothing is left */
+static void _fsk_next(void) {
+    if (_fskFrame == 1) {
+        if (_fskHead == _fskTail) {
+            _fskFrame = 0;
+            _beep_stop();
+            return;
+        }
+        _fskFrame = 0x0600 | (_fskQueue[_fskHead] << 1);  /* marker, stop bit, data, start bit */
+        _fskHead = (_fskHead + 1) & (FSK_QUEUE - 1);
+    }
+    if (_fskFrame & 1) {
+        OCR1C = FSK_MARK_TOP;
+        _len = FSK_MARK_PERIODS;
+    } else {
+        OCR1C = FSK_SPACE_TOP;
+        _len = FSK_SPACE_PERIODS;
+    }
+    OCR1B = OCR1C >> 1;
+    _fskFrame >>= 1;
+}
+#endif
+
+ISR(TIM1_OVF_vect) {
+#ifdef LOGGER
+    if (_fskFrame) {
+        if (--_len == 0) _fsk_next();
+        return;
+    }
+#endif
+    _acc += OCR1C + 1;
+    if (_acc < BEEP_TICK) return;
+    _acc -= BEEP_TICK;
+    if (--_len == 0) _beep_next();
+}
+
 void beep_init(void) {
     /* PB4: PWM with OC1B pin (PB4) */
     DDRB |= (1 << DDB4);
@@ -31,18 +137,50 @@ void beep_init(void) {
 void beep(const beep_t t) {
     if (beep_volume == 0) return;
 
-    uint8_t len;
-    TCCR1 = 1<<CS10;
-    GTCCR = 1 << PWM1B | 1 << COM1B1;
+    uint8_t next = (_tail + 1) & (BEEP_QUEUE - 1);
+    while (next == _head) timer_sleep(0);   /* queue full */
+    _queue[_tail] = t;
+    _tail = next;
 
-    uint8_t pos;
-    for (pos=pgm_read_byte(melody + t); pos < pgm_read_byte(melody + t + 1); pos+=2) {
-        uint8_t tmp = pgm_read_byte(melody + pos);
-        OCR1C = tmp;
-        OCR1B = tmp >> beep_volume;
-        for (len=pgm_read_byte(melody + pos + 1); len>0; len-=1) _delay_ms(10);
+    cli();
+    if (!(TIMSK & (1 << TOIE1))) {
+        /* sequencer is idle: start timer1 with the first note */
+        _pos = _end = 0;
+        _acc = 0;
+        _beep_next();
+        TCCR1 = 1 + TIMER_CLOCK_SHIFT;  /* prescaler: count at F_CPU (see timer.h) */
+        TIFR = 1 << TOV1;
+        TIMSK |= 1 << TOIE1;
     }
+    sei();
+}
 
-    TCCR1 = 0;
-    GTCCR = 0;
+uint8_t beep_busy(void) {
+    return (TIMSK & (1 << TOIE1)) ? 1 : 0;
+}
+
+void beep_wait(void) {
+    while (beep_busy()) timer_sleep(0);
+}
+
+#ifdef LOGGER
+void beep_send(uint8_t data) {
+    if (!_fskFrame) beep_wait();                /* let a melody finish first */
+    uint8_t next = (_fskTail + 1) & (FSK_QUEUE - 1);
+    while (next == _fskHead) timer_sleep(0);    /* queue full */
+    _fskQueue[_fskTail] = data;
+    _fskTail = next;
+
+    cli();
+    if (!(TIMSK & (1 << TOIE1))) {
+        /* start timer1 with the first bit, at full volume */
+        _fskFrame = 1;
+        _fsk_next();
+        GTCCR = 1 << PWM1B | 1 << COM1B1;
+        TCCR1 = 1 + TIMER_CLOCK_SHIFT;  /* prescaler: count at F_CPU (see timer.h) */
+        TIFR = 1 << TOV1;
+        TIMSK |= 1 << TOIE1;
+    }
+    sei();
 }
+#endif
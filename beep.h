@@ -15,10 +15,16 @@ typedef enum {
     BEEP_WARN = 2,
     BEEP_STARTUP = 3,
     BEEP_SHUTDOWN = 4,
+    BEEP_PAUSE = 5,
 } beep_t;
 
 extern uint8_t beep_volume;
 void beep_init(void);
-void beep(const beep_t t);
+void beep(const beep_t t);      /* queue a melody (waits while the queue is full) */
+uint8_t beep_busy(void);
+void beep_wait(void);
+#ifdef LOGGER
+void beep_send(uint8_t data);   /* send a byte as FSK tones (after a playing melody) */
+#endif
 
 #endif /* _BEEP_H */
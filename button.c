@@ -17,8 +17,10 @@
 
 #define BTN_PIN PB1
 
-static uint32_t debounce = 0;
-static uint32_t startPress = 0;
+/* low 16 bits of timer_millis(): the intervals measured are far below a minute */
+static uint16_t debounce = 0;
+static uint16_t startPress = 0;
+static uint8_t held = 0;    /* pressed and not reported as long press yet */
 static uint8_t last_state = (1 << BTN_PIN); /* initialize with HIGH */
 static uint8_t pressed = 0;
 static uint8_t state = (1 << BTN_PIN); /* initialize with HIGH */
@@ -27,7 +29,7 @@ EMPTY_INTERRUPT(PCINT0_vect) /* empty interrupt handler to wake up device from s
 
 void button_reset(void) {
     debounce = 0;
-    startPress = 0;
+    held = 0;
     last_state = (1 << BTN_PIN);
     pressed = 0;
     state = (1 << BTN_PIN);
@@ -44,27 +46,34 @@ void button_init(void) {
 
 void button_read(void) {
     uint8_t r = PINB & (1 << BTN_PIN);
+    uint16_t now = timer_millis();
     if (r != last_state) {
-        debounce = timer_millis();
+        debounce = now;
     }
-    if ((timer_millis() - debounce) > BUTTON_DEBOUNCE_DELAY) {
+    if ((uint16_t)(now - debounce) > BUTTON_DEBOUNCE_DELAY) {
         if (r != state) {
             state = r;
             if (state == 0) {
                 /* button pressed */
-                startPress = timer_millis();
+                startPress = now;
+                held = 1;
             } else {
                 /* button released */
-                if (startPress > 0) pressed = 1;
+                if (held) pressed = 1;
             }
-        } else if (state == 0 && startPress > 0 && timer_millis() - startPress >= BUTTON_LONG) {
+        } else if (state == 0 && held && (uint16_t)(now - startPress) >= BUTTON_LONG) {
             pressed = 2;
-            startPress = 0;
+            held = 0;
         }
     }
     last_state = r;
 }
 
+/* released (and debounced), no press pending: nothing to poll until the next pin change */
+uint8_t button_idle(void) {
+    return state && last_state && (PINB & (1 << BTN_PIN)) && pressed == 0;
+}
+
 uint8_t button_pressed(void) {
     uint8_t ret = pressed;
     pressed = 0;
@@ -16,5 +16,6 @@ void button_reset(void);
 void button_init(void);
 void button_read(void);
 uint8_t button_pressed(void);
+uint8_t button_idle(void);
 
 #endif // _BUTTON_H
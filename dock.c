@@ -0,0 +1,227 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Dock mode: I2C target on the USI (see dock.h for the register map)
+ * Based on Atmel Application Note AVR312. While the device is switched off
+ * (sensor and display without power), the USI start condition detector
+ * stays enabled in power-down: a reader addressing DOCK_ADDRESS wakes us
+ * up. The USI holds SCL low after the start condition and after every byte
+ * until the interrupt handler has dealt with it, so the reader can clock at
+ * any speed. Once the bus has been quiet for DOCK_TIMEOUT, the pins go back
+ * to the I2C master (i2c_init()).
+ */
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include "beep.h"
+#include "i2cmaster.h"
+#include "logger.h"
+#include "main.h"
+#include "timer.h"
+#include "VCC.h"
+#include "dock.h"
+
+#define SDA PB0
+#define SCL PB2
+
+/* two-wire mode, shift register and counter clocked by SCL (both edges);
+ * _HOLD also holds SCL low after a counter overflow */
+#define USICR_WAIT  (_BV(USISIE) | _BV(USIWM1) | _BV(USICS1))
+#define USICR_HOLD  (_BV(USISIE) | _BV(USIOIE) | _BV(USIWM1) | _BV(USIWM0) | _BV(USICS1))
+
+/* clear the flags (except the start condition) and preset the counter */
+#define USISR_8BIT  (_BV(USIOIF) | _BV(USIPF) | _BV(USIDC))
+#define USISR_1BIT  (USISR_8BIT | (0x0E << USICNT0))
+
+static enum {
+    STATE_ADDRESS,      /* address received */
+    STATE_SEND,         /* ACK sent, the reader reads the first byte */
+    STATE_SENT,         /* byte read by the reader */
+    STATE_CHECK,        /* (N)ACK of the reader received */
+    STATE_RECEIVE,      /* ACK sent, next byte written */
+    STATE_RECEIVED,     /* byte written by the reader */
+} _state;
+
+static volatile uint8_t _traffic;   /* bus traffic since the last check */
+static uint8_t _reg;                /* register pointer */
+static uint8_t _written;            /* bytes written in this transfer (the first one is the pointer) */
+static uint16_t _vcc;
+#ifdef INTERVALS
+static volatile uint8_t _interval;  /* DOCK_REG_INTERVAL, saved by dock_run() */
+#endif
+#ifdef LOGGER
+static uint8_t _frame[LOGGER_EXPORT_FRAME];
+static uint8_t _framePos;           /* next byte of _frame, LOGGER_EXPORT_FRAME: fetch the next one */
+static uint8_t _frameEnd;           /* the end frame has been read */
+#endif
+
+static void _setReg(uint8_t reg) {
+    _reg = reg;
+#ifdef LOGGER
+    if (reg == DOCK_REG_LOG) {
+        logger_rewind();
+        _framePos = LOGGER_EXPORT_FRAME;
+        _frameEnd = 0;
+    }
+#endif
+}
+
+static uint8_t _readReg(void) {
+    uint8_t reg = _reg;
+
+    if (reg < DOCK_REGS) _reg++;
+    switch (reg) {
+        case DOCK_REG_ID: return DOCK_ID;
+        case DOCK_REG_VERSION: return DOCK_VERSION;
+#ifdef LOGGER
+        case DOCK_REG_STATUS: return DOCK_STATUS_LOGGER;
+#endif
+        case DOCK_REG_VCC: return _vcc & 0xFF;
+        case DOCK_REG_VCC + 1: return _vcc >> 8;
+#ifdef INTERVALS
+        case DOCK_REG_INTERVAL: return _interval;
+#endif
+        case DOCK_REG_VOLUME: return beep_volume;
+#ifdef LOGGER
+        case DOCK_REG_LOG:
+            if (_framePos == LOGGER_EXPORT_FRAME) {
+                if (_frameEnd) return 0xFF;
+                _frameEnd = logger_frame(_frame);
+                _framePos = 0;
+            }
+            return _frame[_framePos++];
+#endif
+        default: return 0;
+    }
+}
+
+static void _writeReg(uint8_t value) {
+#ifdef INTERVALS
+    if (_reg == DOCK_REG_INTERVAL && value < APP_INTERVAL_COUNT) _interval = value;
+#endif
+    if (_reg == DOCK_REG_VOLUME && value < 4) beep_volume = value;
+    if (_reg < DOCK_REGS) _reg++;
+}
+
+/* wait for the next start condition */
+static void _usi_wait(void) {
+    DDRB &= ~_BV(SDA);
+    USICR = USICR_WAIT;
+    USISR = USISR_8BIT;
+}
+
+ISR(USI_START_vect) {
+    uint16_t n = 0;
+
+    _traffic = 1;
+    _state = STATE_ADDRESS;
+    DDRB &= ~_BV(SDA);
+    /* the start condition is complete once SCL is low (or a stop follows);
+     * the watchdog is off, so a bus stuck in between is given 65536 polls */
+    while ((PINB & _BV(SCL)) && !(PINB & _BV(SDA))) {
+        if (--n == 0) break;
+    }
+    USICR = (PINB & _BV(SCL)) ? USICR_WAIT : USICR_HOLD;
+    USISR = _BV(USISIF) | USISR_8BIT;   /* releases SCL */
+}
+
+ISR(USI_OVF_vect) {
+    uint8_t data = USIDR;
+
+    _traffic = 1;
+    switch (_state) {
+        case STATE_ADDRESS:
+            if ((data >> 1) != DOCK_ADDRESS) {
+                _usi_wait();
+                return;
+            }
+            _written = 0;
+            _state = (data & 1) ? STATE_SEND : STATE_RECEIVE;
+            /* ACK */
+            USIDR = 0;
+            DDRB |= _BV(SDA);
+            USISR = USISR_1BIT;
+            return;
+        case STATE_SENT:
+            /* read the (N)ACK of the reader */
+            DDRB &= ~_BV(SDA);
+            USIDR = 0;
+            USISR = USISR_1BIT;
+            _state = STATE_CHECK;
+            return;
+        case STATE_CHECK:
+            if (data & 1) {
+                /* NACK: the reader is done */
+                _usi_wait();
+                return;
+            }
+            /* fall through */
+        case STATE_SEND:
+            USIDR = _readReg();
+            DDRB |= _BV(SDA);
+            USISR = USISR_8BIT;
+            _state = STATE_SENT;
+            return;
+        case STATE_RECEIVE:
+            /* ACK sent: receive the next byte */
+            DDRB &= ~_BV(SDA);
+            USISR = USISR_8BIT;
+            _state = STATE_RECEIVED;
+            return;
+        case STATE_RECEIVED:
+            if (_written++ == 0) _setReg(data);
+            else _writeReg(data);
+            USIDR = 0;
+            DDRB |= _BV(SDA);
+            USISR = USISR_1BIT;
+            _state = STATE_RECEIVE;
+            return;
+    }
+}
+
+void dock_listen(void) {
+    /* the reader may ask right after the start condition */
+    _vcc = VCC_get();
+#ifdef INTERVALS
+    _interval = app_interval;
+#endif
+    PORTB |= _BV(SDA) | _BV(SCL);
+    DDRB |= _BV(SCL);
+    _traffic = 0;
+    _usi_wait();
+}
+
+uint8_t dock_run(void) {
+    uint32_t quiet;
+
+    if (!_traffic) {
+        /* woken up by the button */
+        USICR = 0;
+        i2c_init();
+        return 0;
+    }
+    quiet = timer_millis();
+    while (timer_elapsed(quiet) < DOCK_TIMEOUT) {
+        if (_traffic) {
+            _traffic = 0;
+            quiet = timer_millis();
+        }
+#ifdef INTERVALS
+        if (_interval != app_interval) {
+            app_interval = _interval;
+            eeprom_update_byte(&app_interval_ee, app_interval);
+        }
+#endif
+        /* idle sleep at full speed: timer0 wakes us up every 33ms */
+        wdt_reset();
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
+    }
+    USICR = 0;
+    i2c_init();
+    return 1;
+}
@@ -0,0 +1,37 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Dock mode: I2C target on the USI for a reader on the bus (build with -DDOCK=ON)
+ */
+
+#ifndef _DOCK_H
+#define _DOCK_H
+
+#include <stdint.h>
+
+#define DOCK_ADDRESS        0x2C    /* 7 bit address */
+#define DOCK_TIMEOUT        1000    /* ms without bus traffic: the reader is gone */
+
+/* Register map: the first byte written after the address sets the register
+ * pointer, further bytes written and bytes read continue from there (the
+ * pointer increments, except on DOCK_REG_LOG). */
+#define DOCK_REG_ID         0x00    /* DOCK_ID (r) */
+#define DOCK_REG_VERSION    0x01    /* DOCK_VERSION (r) */
+#define DOCK_REG_STATUS     0x02    /* DOCK_STATUS_* (r) */
+#define DOCK_REG_VCC        0x03    /* battery voltage in 10mV, 2 bytes LSB first (r) */
+#define DOCK_REG_INTERVAL   0x05    /* measurement interval, index into app_intervals (r/w, 0 without INTERVALS) */
+#define DOCK_REG_VOLUME     0x06    /* beep volume 0..3 (r/w) */
+#define DOCK_REG_LOG        0x10    /* log stream (r), setting the pointer rewinds it: frames
+                                     * as sent by logger_export(), then 0xFF */
+#define DOCK_REGS           0x07    /* registers below DOCK_REG_LOG */
+
+#define DOCK_ID             0xC2
+#define DOCK_VERSION        1
+#define DOCK_STATUS_LOGGER  0x01    /* built with the data logger */
+
+void dock_listen(void);     /* before power-down (keep the USI powered): a start condition on the bus wakes us up */
+uint8_t dock_run(void);     /* after power-down: serve the reader until it's gone, returns 0 if there was none */
+
+#endif /* _DOCK_H */
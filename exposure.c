@@ -0,0 +1,64 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * CO₂ exposure since power-on: 8h TWA and 15min STEL
+ * The latest CO₂ value is added up every second in units of 64ppm*s (the
+ * rest is carried to the next second). Each minute goes into a ring of 15
+ * minutes in units of 1024ppm*s, and into the dose since power-on in units
+ * of 16384ppm*s; the rests are carried again, so nothing gets lost. At most
+ * 40000ppm, everything fits 16 bits: the running sum of the ring gives the
+ * STEL, the dose over 8 hours the TWA (it keeps growing after 8 hours, as
+ * the exposure does, and saturates at about 37000ppm). Nothing but additions
+ * and shifts; 40 bytes of RAM.
+ */
+
+#include "exposure.h"
+
+static uint16_t _ring[EXPOSURE_SLOTS];  /* ppm*s / 1024 per minute, _ring[_pos] is the oldest */
+static uint16_t _stel;                  /* sum of _ring */
+static uint16_t _dose;                  /* ppm*s / 16384 since power-on */
+static uint16_t _minute;                /* ppm*s / 64 of the running minute */
+static uint8_t _doseRest;               /* ppm*s / 1024 not yet in _dose */
+static uint8_t _rest;                   /* ppm*s not yet in _minute */
+static uint8_t _pos;
+static uint8_t _secs;
+
+void exposure_reset(void) {
+    for (uint8_t i = 0; i < EXPOSURE_SLOTS; i++) _ring[i] = 0;
+    _stel = _dose = _minute = 0;
+    _doseRest = _rest = _pos = _secs = 0;
+}
+
+uint8_t exposure_second(uint16_t co2) {
+    _rest += co2 & 63;
+    _minute += (co2 >> 6) + (_rest >> 6);
+    _rest &= 63;
+    if (++_secs < EXPOSURE_SLOT) return 0;
+
+    uint16_t slot = _minute >> 4;
+    _minute &= 15;
+    _stel += slot - _ring[_pos];
+    _ring[_pos] = slot;
+    if (++_pos == EXPOSURE_SLOTS) _pos = 0;
+    slot += _doseRest;
+    _doseRest = slot & 15;
+    slot = (slot >> 4) + _dose;
+    _dose = slot < _dose ? 0xFFFF : slot;
+    _secs = 0;
+    return 1;
+}
+
+/* x * 1.1387 for x < 2^15 (for 1024 / 900 = 1.1378: 15min = 900s, 8h = 2 * 16384/1.1378s) */
+static uint16_t _scale(uint16_t x) {
+    return x + (x >> 3) + (x >> 6) - (x >> 9);
+}
+
+uint16_t exposure_twa(void) {
+    return _scale(_dose >> 1);
+}
+
+uint16_t exposure_stel(void) {
+    return _scale(_stel);
+}
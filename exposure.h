@@ -0,0 +1,27 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * CO₂ exposure since power-on: 8h TWA and 15min STEL (build with -DEXPOSURE=ON)
+ */
+
+#ifndef _EXPOSURE_H
+#define _EXPOSURE_H
+
+#include <stdint.h>
+
+/* workplace limits in Germany (TRGS 900): 5000ppm over 8 hours, short-term
+ * (15 minutes) twice as much */
+#define EXPOSURE_TWA_LIMIT  5000    /* ppm */
+#define EXPOSURE_STEL_LIMIT 10000   /* ppm */
+
+#define EXPOSURE_SLOT       60      /* seconds */
+#define EXPOSURE_SLOTS      15      /* STEL window: 15 minutes */
+
+void exposure_reset(void);
+uint8_t exposure_second(uint16_t co2);  /* returns non-zero when a minute is complete */
+uint16_t exposure_twa(void);            /* ppm, time-weighted over 8 hours */
+uint16_t exposure_stel(void);           /* ppm, average of the last 15 complete minutes */
+
+#endif /* !_EXPOSURE_H */
@@ -2,7 +2,7 @@
 #define _I2CMASTER_H
 /************************************************************************* 
 * Title:    C include file for the I2C master interface 
-*           (i2cmaster.S or twimaster.c)
+*           (i2cmaster.S, twimaster.c or usimaster.c)
 * Author:   Peter Fleury <pfleury@gmx.ch>
 * File:     $Id: i2cmaster.h,v 1.12 2015/09/16 09:27:58 peter Exp $
 * Software: AVR-GCC 4.x
@@ -24,6 +24,7 @@
  which runs on any AVR (i2cmaster.S) and as a TWI hardware interface for all AVR with built-in TWI hardware (twimaster.c).
  Since the API for these two implementations is exactly the same, an application can be linked either against the
  software I2C implementation or the hardware I2C implementation.
+ On the ATtiny85, usimaster.c implements the same API on the USI (CMake option I2C_USI).
 
  Use 4.7k pull-up resistor on the SDA and SCL pin.
  
@@ -94,6 +95,24 @@
 /** defines the data direction (writing to I2C device) in i2c_start(),i2c_rep_start() */
 #define I2C_WRITE   0
 
+/** standard mode (100kHz) for i2c_speed() */
+#define I2C_STANDARD 0
+
+/** fast mode (400kHz, default) for i2c_speed() */
+#define I2C_FAST     1
+
+/** ack polls of i2c_start_wait() before it gives up (about 50ms in fast mode, 140ms in standard mode) */
+#define I2C_START_TRIES 1024
+
+/**
+ Set when a bus operation timed out: SCL held low by a device for longer than
+ 65536 polls (about 40ms), or no answer to i2c_start_wait(). Until the next
+ i2c_start() or i2c_start_wait() clears it, i2c_write() and i2c_read() return
+ at once without touching the bus (a byte in progress stops at the bit that
+ timed out), so a transaction on a hung bus costs at most one timeout.
+ */
+extern unsigned char i2c_timeout;
+
 
 /**
  @brief initialize the I2C master interface. Need to be called only once
@@ -102,6 +121,14 @@
 void i2c_init(void);
 
 
+/**
+ @brief Select the bus speed, timing is computed for F_CPU_FAST
+ @param    fast I2C_STANDARD or I2C_FAST
+ @return   none
+ */
+void i2c_speed(unsigned char fast);
+
+
 /** 
  @brief Terminates the data transfer and releases the I2C bus 
  @return none
@@ -133,17 +160,19 @@ unsigned char i2c_rep_start(unsigned char addr);
  @brief Issues a start condition and sends address and transfer direction 
    
  If device is busy, use ack polling to wait until device ready 
+ (at most I2C_START_TRIES polls)
  @param    addr address and transfer direction of I2C device
- @return   none
+ @retval   0 device accessible
+ @retval   1 timeout, i2c_timeout is set
  */
-void i2c_start_wait(unsigned char addr);
+unsigned char i2c_start_wait(unsigned char addr);
 
  
 /**
  @brief Send one byte to I2C device
  @param    data  byte to be transfered
  @retval   0 write successful
- @retval   1 write failed
+ @retval   1 write failed (NACK or i2c_timeout)
  */
 unsigned char i2c_write(unsigned char data);
 
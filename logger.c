@@ -0,0 +1,300 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Data logger: ring buffer of measurements in the EEPROM
+ * The log is a ring of blocks. Each block starts with a keyframe (absolute
+ * values, sequence number and CRC) followed by the changes of the next
+ * samples, coded in nibbles (see below). A damaged block only loses its own
+ * samples, the next keyframe starts over. The blocks are reused round-robin,
+ * so every cell gets the same share of the EEPROM's ~100.000 write cycles.
+ *
+ * Sample: [E] mask [co2] [temp] [humidity], then F (end of the block data)
+ *  E       first sample after power-on (keyframes: bit 7 of the humidity)
+ *  mask    0..7: bit 0 CO₂, bit 1 temperature, bit 2 humidity changed
+ *  values  only those in mask: difference to the previous sample, zigzag
+ *          coded (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...), 3 bits per nibble,
+ *          least significant first, bit 3 set if another nibble follows
+ * An unchanged sample takes one nibble, typical changes (CO₂ by a few ppm,
+ * temperature by 0.1°C) two or three. A sample is written back to front, so
+ * its first byte (which holds the previous end marker) is written last: a
+ * power loss in between leaves the block as it was.
+ */
+
+#include <avr/eeprom.h>
+#include "SCD4x.h"
+#include "beep.h"
+#include "logger.h"
+
+/* keyframe: sequence number, CO₂ (LSB first), temperature (LSB first),
+ * humidity (bit 7: first record after power-on), CRC of the bytes before */
+#define KEYFRAME_SIZE   7
+#define DATA_NIBBLES    ((LOGGER_BLOCK_SIZE - KEYFRAME_SIZE) * 2)
+
+#define CODE_SESSION    0x0E
+#define CODE_END        0x0F
+#define NIBBLES_MAX     18      /* session, mask, 6+6+3 value nibbles, end */
+
+#define NEXT_KEYFRAME   0xFF    /* _readPos: the next record is a keyframe */
+
+/* dead band (LOGGER_TOLERANCE > 0): changes within about the repeatability of
+ * the SCD4x are not recorded, CO₂ see logger_append() */
+#if LOGGER_TOLERANCE > 0
+#define TEMP_TOLERANCE      1       /* 1/10 °C */
+#define HUMIDITY_TOLERANCE  1       /* %RH */
+#else
+#define TEMP_TOLERANCE      0
+#define HUMIDITY_TOLERANCE  0
+#endif
+
+static uint8_t EEMEM _log[LOGGER_BLOCKS][LOGGER_BLOCK_SIZE];
+static uint8_t _block = LOGGER_BLOCKS - 1;  /* block being filled */
+static uint8_t _pos = DATA_NIBBLES;         /* its end marker (full: start a new block) */
+static uint8_t _seq = 0;                    /* its sequence number */
+static uint8_t _session = 0;                /* next sample is the first one after power-on */
+static logger_record_t _last;               /* last sample written */
+
+static uint8_t _readBlock, _readBlocks, _readPos, _readSeq, _readAny;
+static uint16_t _readCount;                 /* records returned since logger_rewind() */
+static logger_record_t _read;               /* last record returned by logger_read() */
+
+/* read the keyframe of a block, returns 1 if its CRC is valid */
+static uint8_t _readKeyframe(uint8_t block, uint8_t *buf) {
+    eeprom_read_block(buf, _log[block], KEYFRAME_SIZE);
+    return SCD4x_computeCRC8(buf, KEYFRAME_SIZE - 1) == buf[KEYFRAME_SIZE - 1];
+}
+
+static void _keyframeRecord(const uint8_t *buf, logger_record_t *r) {
+    r->co2 = buf[1] | (buf[2] << 8);
+    r->temp = (int16_t)(buf[3] | (buf[4] << 8));
+    r->humidity = buf[5] & 0x7F;
+    r->flags = (buf[5] & 0x80) ? LOGGER_FLAG_SESSION : 0;
+}
+
+static uint8_t _nibble(uint8_t block, uint8_t pos) {
+    uint8_t b = eeprom_read_byte(&_log[block][KEYFRAME_SIZE + pos / 2]);
+    return (pos & 1) ? b & 0x0F : b >> 4;
+}
+
+/* decode the value of one channel, returns 1 if it runs past the block */
+static uint8_t _decodeValue(uint8_t block, uint8_t *pos, uint16_t *v) {
+    uint16_t z = 0;
+    uint8_t n, shift = 0;
+
+    do {
+        if (*pos >= DATA_NIBBLES || shift > 15) return 1;
+        n = _nibble(block, (*pos)++);
+        z |= (uint16_t)(n & 0x07) << shift;
+        shift += 3;
+    } while (n & 0x08);
+    *v += (z & 1) ? ~(z >> 1) : z >> 1;
+    return 0;
+}
+
+/* apply the next sample of a block to r, returns 1 at the end of the block */
+static uint8_t _decode(uint8_t block, uint8_t *pos, logger_record_t *r) {
+    uint16_t v;
+    uint8_t mask;
+
+    if (*pos >= DATA_NIBBLES) return 1;
+    mask = _nibble(block, *pos);
+    r->flags = 0;
+    if (mask == CODE_SESSION) {
+        r->flags = LOGGER_FLAG_SESSION;
+        if (++(*pos) >= DATA_NIBBLES) return 1;
+        mask = _nibble(block, *pos);
+    }
+    if (mask > 7) return 1;     /* end marker */
+    (*pos)++;
+    if (mask & 1) {
+        if (_decodeValue(block, pos, &r->co2)) return 1;
+    }
+    if (mask & 2) {
+        v = r->temp;
+        if (_decodeValue(block, pos, &v)) return 1;
+        r->temp = v;
+    }
+    if (mask & 4) {
+        v = r->humidity;
+        if (_decodeValue(block, pos, &v)) return 1;
+        r->humidity = v;
+    }
+    return 0;
+}
+
+static uint8_t _encodeValue(uint8_t *nib, uint8_t len, uint16_t diff) {
+    uint16_t z = (diff << 1) ^ ((diff & 0x8000) ? 0xFFFF : 0);
+    while (z > 7) {
+        nib[len++] = 0x08 | (z & 0x07);
+        z >>= 3;
+    }
+    nib[len++] = z;
+    return len;
+}
+
+/* write nibbles at _pos, last byte first */
+static void _writeNibbles(const uint8_t *nib, uint8_t len) {
+    uint8_t first = _pos / 2, b = (_pos + len - 1) / 2;
+
+    for (;;) {
+        uint8_t hi = b * 2 - _pos, lo = hi + 1;    /* index into nib (wraps if before _pos) */
+        uint8_t value = hi < len ? nib[hi] << 4 : eeprom_read_byte(&_log[_block][KEYFRAME_SIZE + b]) & 0xF0;
+        value |= lo < len ? nib[lo] : CODE_END;
+        eeprom_update_byte(&_log[_block][KEYFRAME_SIZE + b], value);
+        if (b-- == first) break;
+    }
+}
+
+static void _newBlock(uint16_t co2, int16_t temp, uint8_t humidity) {
+    uint8_t buf[KEYFRAME_SIZE];
+
+    if (++_block == LOGGER_BLOCKS) _block = 0;
+    /* empty the block before its keyframe becomes valid */
+    eeprom_update_byte(&_log[_block][KEYFRAME_SIZE], 0xFF);
+    buf[0] = ++_seq;
+    buf[1] = co2 & 0xFF;
+    buf[2] = co2 >> 8;
+    buf[3] = temp & 0xFF;
+    buf[4] = (uint16_t)temp >> 8;
+    buf[5] = (humidity & 0x7F) | (_session << 7);
+    buf[6] = SCD4x_computeCRC8(buf, KEYFRAME_SIZE - 1);
+    eeprom_update_block(buf, _log[_block], KEYFRAME_SIZE);
+    _pos = 0;
+}
+
+void logger_init(void) {
+    uint8_t buf[KEYFRAME_SIZE];
+    uint8_t found = 0;
+
+    /* the newest block is the valid one not followed by its successor */
+    for (uint8_t i = 0; i < LOGGER_BLOCKS; i++) {
+        if (!_readKeyframe(i, buf)) continue;
+        uint8_t seq = buf[0];
+        if (_readKeyframe(i + 1 < LOGGER_BLOCKS ? i + 1 : 0, buf) && buf[0] == (uint8_t)(seq + 1)) continue;
+        if (!found || (int8_t)(seq - _seq) > 0) {
+            _block = i;
+            _seq = seq;
+        }
+        found = 1;
+    }
+    if (found) {
+        /* continue after its last sample */
+        _readKeyframe(_block, buf);
+        _keyframeRecord(buf, &_last);
+        _pos = 0;
+        while (!_decode(_block, &_pos, &_last));
+        /* damaged data: start a new block */
+        if (_pos < DATA_NIBBLES && _nibble(_block, _pos) != CODE_END) _pos = DATA_NIBBLES;
+    }
+    _session = 1;
+}
+
+void logger_append(uint16_t co2, int16_t temp, uint8_t humidity) {
+    uint8_t nib[NIBBLES_MAX];
+    uint8_t len = 0, mask = 0;
+#if LOGGER_TOLERANCE > 0
+    uint16_t tolerance = _last.co2 / 64;    /* relative for high concentrations */
+    if (tolerance < LOGGER_TOLERANCE) tolerance = LOGGER_TOLERANCE;
+#else
+    const uint16_t tolerance = 0;
+#endif
+
+    if (_session) nib[len++] = CODE_SESSION;
+    len++;
+    if (co2 > _last.co2 + tolerance || co2 + tolerance < _last.co2) {
+        mask |= 1;
+        len = _encodeValue(nib, len, co2 - _last.co2);
+    }
+    if (temp > _last.temp + TEMP_TOLERANCE || temp + TEMP_TOLERANCE < _last.temp) {
+        mask |= 2;
+        len = _encodeValue(nib, len, temp - _last.temp);
+    }
+    if (humidity > _last.humidity + HUMIDITY_TOLERANCE || humidity + HUMIDITY_TOLERANCE < _last.humidity) {
+        mask |= 4;
+        len = _encodeValue(nib, len, humidity - _last.humidity);
+    }
+    nib[_session] = mask;
+
+    if (_pos + len > DATA_NIBBLES) {
+        /* block full: the sample becomes the keyframe of the next one */
+        _newBlock(co2, temp, humidity);
+        mask = 7;
+    } else {
+        uint8_t end = _pos + len;
+        if (end < DATA_NIBBLES) nib[len++] = CODE_END;
+        _writeNibbles(nib, len);
+        _pos = end;
+    }
+    /* the values recorded (within the dead band, the previous ones) */
+    if (mask & 1) _last.co2 = co2;
+    if (mask & 2) _last.temp = temp;
+    if (mask & 4) _last.humidity = humidity;
+    _session = 0;
+}
+
+void logger_rewind(void) {
+    _readBlock = _block;
+    _readBlocks = LOGGER_BLOCKS;
+    _readPos = NEXT_KEYFRAME;
+    _readAny = 0;
+    _readCount = 0;
+}
+
+uint8_t logger_read(logger_record_t *r) {
+    uint8_t buf[KEYFRAME_SIZE];
+
+    while (_readPos == NEXT_KEYFRAME || _decode(_readBlock, &_readPos, &_read)) {
+        /* next block, starting after the newest */
+        if (_readBlocks == 0) return 1;
+        _readBlocks--;
+        if (++_readBlock == LOGGER_BLOCKS) _readBlock = 0;
+        _readPos = NEXT_KEYFRAME;
+        if (!_readKeyframe(_readBlock, buf)) continue;
+        _keyframeRecord(buf, &_read);
+        if (_readAny && buf[0] != (uint8_t)(_readSeq + 1)) _read.flags |= LOGGER_FLAG_GAP;
+        _readSeq = buf[0];
+        _readAny = 1;
+        _readPos = 0;
+        break;
+    }
+    *r = _read;
+    _readCount++;
+    return 0;
+}
+
+uint8_t logger_frame(uint8_t *buf) {
+    logger_record_t r;
+    uint8_t end = logger_read(&r);
+
+    if (end) {
+        buf[0] = LOGGER_EXPORT_END;
+        buf[1] = _readCount & 0xFF;
+        buf[2] = _readCount >> 8;
+        buf[3] = buf[4] = buf[5] = buf[6] = 0;
+    } else {
+        buf[0] = LOGGER_EXPORT_RECORD;
+        buf[1] = r.co2 & 0xFF;
+        buf[2] = r.co2 >> 8;
+        buf[3] = r.temp & 0xFF;
+        buf[4] = (uint16_t)r.temp >> 8;
+        buf[5] = r.humidity;
+        buf[6] = r.flags;
+    }
+    buf[LOGGER_EXPORT_FRAME - 1] = SCD4x_computeCRC8(buf, LOGGER_EXPORT_FRAME - 1);
+    return end;
+}
+
+uint16_t logger_export(void) {
+    uint8_t buf[LOGGER_EXPORT_FRAME];
+    uint8_t end;
+
+    for (uint8_t i = 0; i < LOGGER_EXPORT_LEADER; i++) beep_send(0xFF);
+    logger_rewind();
+    do {
+        end = logger_frame(buf);
+        for (uint8_t i = 0; i < LOGGER_EXPORT_FRAME; i++) beep_send(buf[i]);
+    } while (!end);
+    beep_wait();
+    return _readCount;
+}
@@ -0,0 +1,55 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Data logger: ring buffer of measurements in the EEPROM (build with -DLOGGER=ON)
+ */
+
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include <stdint.h>
+
+/* The EEPROM holds the font (364 bytes) and app_interval_ee; the splash image
+ * is left out in logger builds, which leaves 147 bytes for the log. Exact
+ * samples take 17 (stable air, sensor noise only) to 31 bits (steep ascent,
+ * co2-sim), so the log keeps the last 40-70 records: 3-5 hours at one record
+ * every 5 minutes. A dead band of 10 ppm (LOGGER_TOLERANCE) brings that down
+ * to 5-25 bits: 1-4 hours at one record per minute, 4-16 hours at 5 minutes. */
+#define LOGGER_BLOCKS       3
+#define LOGGER_BLOCK_SIZE   49
+#ifndef LOGGER_TOLERANCE
+#define LOGGER_TOLERANCE    0       /* CO₂ dead band in ppm (0: every change is recorded, see CMakeLists.txt) */
+#endif
+#ifndef LOGGER_INTERVAL
+#define LOGGER_INTERVAL     300     /* seconds between two records (see CMakeLists.txt) */
+#endif
+
+/* logger_export() sends 0.5s of 0xFF bytes, then frames of 8 bytes: type,
+ * 6 bytes payload, CRC (as SCD4x) of the 7 bytes before
+ *  LOGGER_EXPORT_RECORD    CO₂ (LSB first), temperature (LSB first), humidity, flags
+ *  LOGGER_EXPORT_END       number of records (LSB first), 0, 0, 0, 0 */
+#define LOGGER_EXPORT_LEADER    50
+#define LOGGER_EXPORT_RECORD    0x5A
+#define LOGGER_EXPORT_END       0xA5
+#define LOGGER_EXPORT_FRAME     8
+
+#define LOGGER_FLAG_SESSION 0x01    /* first record after power-on */
+#define LOGGER_FLAG_GAP     0x02    /* records before this one are lost (damaged block) */
+
+typedef struct {
+    uint16_t co2;       /* ppm */
+    int16_t temp;       /* 1/10 °C */
+    uint8_t humidity;   /* %RH */
+    uint8_t flags;      /* LOGGER_FLAG_* */
+} logger_record_t;
+
+void logger_init(void);
+void logger_append(uint16_t co2, int16_t temp, uint8_t humidity);
+void logger_rewind(void);                   /* logger_read() starts with the oldest record */
+uint8_t logger_read(logger_record_t *r);    /* next record, returns 1 after the newest */
+uint8_t logger_frame(uint8_t *buf);         /* next export frame after logger_rewind(), returns 1 for the end frame */
+uint16_t logger_export(void);               /* send all records through the buzzer, returns their number */
+
+#endif /* _LOGGER_H */
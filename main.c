@@ -6,14 +6,25 @@
  * Program entry and main measurement loop
  */
 
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
 #include <avr/pgmspace.h>
-#include <util/delay.h>
+#include <avr/sleep.h>
 #include "beep.h"
 #include "button.h"
 #include "i2cmaster.h"
+#include "logger.h"
 #include "menu.h"
-#include "splash.h"
+#ifndef LOGGER
+#include "splash.h"     /* generated from splash.png, in the EEPROM, which the logger needs */
+#endif
 #include "timer.h"
+#ifdef TREND
+#include "trend.h"
+#endif
+#ifdef EXPOSURE
+#include "exposure.h"
+#endif
 #include "SSD1306.h"
 #include "SCD4x.h"
 #include "VCC.h"
@@ -21,6 +32,19 @@
 
 #define VCC_MIN 280 /* minimum voltage: 2.80V */
 #define VCC_MAX 370 /* maximum voltage: 3.70V */
+#if VCC_MAX - VCC_MIN != 90
+#error "the percentage in main_loop() is computed for a range of 90"
+#endif
+
+/* Display power: dimmed DISPLAY_DIM seconds after the last button press or
+ * alarm, switched off after DISPLAY_TIMEOUT seconds (0: never, set by CMake).
+ * The display keeps its RAM while it's off and is updated as usual, so it's
+ * back with the current values right away. */
+#ifndef DISPLAY_TIMEOUT
+#define DISPLAY_TIMEOUT 120
+#endif
+#define DISPLAY_DIM 30
+#define DISPLAY_CONTRAST_DIM 0x00
 
 const char app_version[] PROGMEM = "V35 - 2026-06-27";
 
@@ -31,22 +55,157 @@ static void writeBattery(uint8_t pct) {
     if (oldPct == pct) return; /* nothing has changed */
     oldPct = pct;
     /* uint8_t img[] = {0x18, 0x7e, 0x42, 0x42, 0x7e, 0x7e, 0x7e, 0x7e, 0x7e, 0x7e, 0x7e, 0x7e, 0x7e}; */
-    uint8_t img[13];
+    static uint8_t img[13];     /* static: no stack frame needed */
     img[0] = 0x18;
     img[1] = img[12] = 0x7e;
-    for (uint8_t x=0; x<10; x++) {
-        img[11-x] = pct > x*10 ? 0x7e : 0x42;
+    for (uint8_t x = 11, level = 0; x > 1; x--, level += 10) {
+        img[x] = pct > level ? 0x7e : 0x42;
     }
     SSD1306_writeImg(0, 0, 13, 8, img, 0);
+    /* the spaces clear what's left of a longer number */
     uint8_t x = SSD1306_writeInt(2, 0, pct, 10, 0x00, 0);
-    SSD1306_writeChar(x++, 0, '%', 0);
-    while (x < 6) SSD1306_writeChar(x++, 0, ' ', 0);
+    SSD1306_writeString(x, 0, PSTR("%  "), SSD1306_FLAG_PGM);
 }
 
 static uint8_t tick;
 static uint16_t co2max = 0;
 static uint16_t lastThreshold = 2000;
-static uint8_t belowThresholdSecs = 0;
+static uint16_t belowThresholdSecs = 0;
+
+/* measurement interval in seconds: periodic measurement, low power periodic
+ * measurement or SCD41 single shots (see APP_INTERVAL_SINGLE_SHOT) */
+#ifdef INTERVALS
+const uint16_t app_intervals[APP_INTERVAL_COUNT] = {5, 30, 60, 300};
+uint8_t app_interval = 0;
+uint8_t EEMEM app_interval_ee = 0;
+#else
+const uint16_t app_intervals[APP_INTERVAL_COUNT] = {5};
+#endif
+static uint16_t warmupSecs;     /* end of the warm-up phase: first measurement after 90 seconds */
+static uint16_t dataSecs;       /* seconds since the last periodic measurement result */
+static uint16_t shotSecs;       /* seconds since the last full single shot */
+static uint8_t climateSecs;     /* the same, modulo 30 (next temperature and humidity shot at 0) */
+static uint8_t shotPending;     /* running single shot: 0=none, 1=temperature and humidity only, 2=full */
+#ifdef LOGGER
+static uint16_t logSecs;        /* seconds since the last log record */
+#endif
+
+/* Sensor health: after a strong shock, the sensor may "hang" (no new data, or
+ * the same values over and over). Every recovery that doesn't help is
+ * followed by the next step: restart the measurement, reinit the sensor
+ * (settings reloaded from its EEPROM), power cycle sensor and display. */
+#define HEALTH_SAME_MAX 8       /* identical readings in a row */
+static uint8_t staleSecs;       /* seconds without new data */
+static uint8_t sameCount;       /* readings identical to the previous one */
+static uint16_t lastCo2;
+static int16_t lastTemp;
+static uint8_t lastHumidity;
+static uint8_t recoverStage;    /* 0: healthy, else the last recovery step (1..3) */
+static uint16_t stuckSecs;      /* timer_seconds() when the sensor was found stuck (low 16 bits) */
+
+static uint16_t displaySecs;    /* seconds since the last button press or alarm */
+
+/* full contrast, display on */
+static void displayWake(void) {
+    if (displaySecs >= DISPLAY_DIM) SSD1306_contrast(SSD1306_CONTRAST);
+#if DISPLAY_TIMEOUT > 0
+    if (displaySecs >= DISPLAY_TIMEOUT) SSD1306_on();
+#endif
+    displaySecs = 0;
+}
+
+#ifdef TREND
+static uint16_t trendWarned;    /* lastThreshold of the last early warning */
+
+/* row 1: rate of change and minutes until the next alarm (inverted when close),
+ * early warning once per threshold */
+static void writeTrend(void) {
+    int16_t slope = trend_slope();
+    uint8_t eta = trend_eta(lastThreshold + 2000);
+    uint8_t flags = eta <= TREND_WARN ? SSD1306_FLAG_INVERTED : 0;
+
+    SSD1306_writeChar(0, 1, slope < 0 ? '-' : '+', 0);
+    SSD1306_writeInt(1, 1, slope < 0 ? -slope : slope, 10, 0, 4);
+    SSD1306_writeString(5, 1, PSTR("/MIN"), SSD1306_FLAG_PGM);
+    if (eta == TREND_ETA_NONE) {
+        SSD1306_writeString(10, 1, PSTR("      "), SSD1306_FLAG_PGM);
+        return;
+    }
+    SSD1306_writeInt(10, 1, eta, 10, flags, 3);
+    SSD1306_writeString(13, 1, PSTR("MIN"), SSD1306_FLAG_PGM | flags);
+    if (flags && trendWarned != lastThreshold) {
+        trendWarned = lastThreshold;
+        displayWake();
+        beep(BEEP_SHORT);
+        beep(BEEP_PAUSE);
+        beep(BEEP_SHORT);
+    }
+}
+#endif
+
+#ifdef EXPOSURE
+static uint8_t showExposure;    /* rows 2-3: the exposure instead of temperature and humidity (long press) */
+static uint8_t exposureOver;    /* limits exceeded: 1=TWA, 2=STEL */
+
+/* once a minute: alarm when a limit is exceeded, values (inverted above the limit) */
+static void writeExposure(void) {
+    uint16_t twa = exposure_twa(), stel = exposure_stel();
+    uint8_t over = (twa >= EXPOSURE_TWA_LIMIT) | (stel >= EXPOSURE_STEL_LIMIT) << 1;
+
+    if (over & ~exposureOver) {
+        displayWake();
+        beep(BEEP_WARN);
+        beep(BEEP_SHORT);
+        beep(BEEP_SHORT);
+    }
+    exposureOver = over;
+    if (!showExposure) return;
+    SSD1306_writeInt(5, 2, twa, 10, (over & 1) ? SSD1306_FLAG_INVERTED : 0, 6);
+    SSD1306_writeInt(5, 3, stel, 10, (over & 2) ? SSD1306_FLAG_INVERTED : 0, 6);
+}
+#endif
+
+/* rows 2-3: labels for temperature and humidity, or for the exposure */
+static void writeLabels(void) {
+#ifdef EXPOSURE
+    if (showExposure) {
+        SSD1306_writeString(0, 2, PSTR("TWA         PPM "), SSD1306_FLAG_PGM);
+        SSD1306_writeString(0, 3, PSTR("STEL        PPM "), SSD1306_FLAG_PGM);
+        return;
+    }
+#endif
+    SSD1306_writeString(4, 3, PSTR("."), 1);
+    SSD1306_writeString(7, 2, PSTR("[C"), 1);   /* '[' is displayed as '°' */
+    SSD1306_writeString(14, 2, PSTR("%"), 1);
+    SSD1306_writeString(14, 3, PSTR("RH"), 1);
+}
+
+static void writeClimate(uint8_t flags) {
+#ifdef EXPOSURE
+    if (showExposure) return;
+#endif
+    /* whole degrees and tenths: count the tens off instead of dividing (at most 130);
+     * below zero, the sign takes the place of the tens, so the display ends at -9.9°C
+     * (the sensor is specified down to -10°C) */
+    int16_t tenths = SCD4x_VALUE_temp;
+    uint8_t degrees = 0;
+    if (tenths < -99) tenths = -99;
+    if (tenths < 0) tenths = -tenths;
+    while (tenths >= 10) {
+        tenths -= 10;
+        degrees++;
+    }
+    SSD1306_writeInt(0, 2, degrees, 10, flags, 2);
+    if (SCD4x_VALUE_temp < 0) SSD1306_writeChar(0, 2, '-', flags);
+    SSD1306_writeInt(5, 2, tenths, 10, flags, 0);
+    SSD1306_writeInt(10, 2, SCD4x_VALUE_humidity, 10, flags, 2);
+}
+
+/* remaining seconds of the warm-up phase */
+static uint16_t warmup(void) {
+    uint32_t secs = timer_seconds();
+    return secs < warmupSecs ? warmupSecs - secs : 0;
+}
 
 typedef enum {
     MAIN_STATE_EMPTY,
@@ -55,76 +214,191 @@ typedef enum {
 } main_state_t;
 static main_state_t main_state = MAIN_STATE_EMPTY;
 
+/* the labels of the measurement screen */
+static void writeFrame(void) {
+    writeLabels();
+
+    if (main_state == MAIN_STATE_RUNNING || warmup() == 0) {
+        SSD1306_writeString(0, 5, PSTR("CO2 MAX:"), 1);
+        SSD1306_writeInt(9, 5, co2max, 10, 0, 0);
+    } else {
+        SSD1306_writeString(0, 5, PSTR("INIT:"), 1);
+        SSD1306_writeInt(6, 5, warmup(), 10, 0, 3);
+    }
+    SSD1306_writeString(12, 6, PSTR("CO2"), 1);
+    SSD1306_writeString(12, 7, PSTR("PPM"), 1);
+}
+
 static void main_enter(void) {
+    uint8_t err;
     tick = 0;
     SSD1306_clear();
 
-    if (SCD4x_startPeriodicMeasurement() != 0) {
-        SSD1306_writeString(0, 2, PSTR("START ERROR"), 1);
+#ifdef INTERVALS
+    if (app_interval >= APP_INTERVAL_SINGLE_SHOT && SCD4x_getSensorType() != SCD4x_SENSOR_SCD41) {
+        app_interval = 0;   /* single shots are not supported by the SCD40 */
+    }
+#endif
+    uint16_t interval = app_intervals[app_interval];
+    warmupSecs = interval;  /* a whole number of intervals */
+    while (warmupSecs < 90) warmupSecs += interval;
+#ifdef TREND
+    trend_reset(app_interval == 0 ? TREND_EMA_SHIFT : 0);
+#endif
+    if (app_interval < APP_INTERVAL_SINGLE_SHOT) {
+        err = app_interval == 0 ? SCD4x_startPeriodicMeasurement() : SCD4x_startLowPowerPeriodicMeasurement();
+        if (err != 0) {
+            SSD1306_writeString(0, 2, PSTR("START ERROR"), 1);
+        }
+        dataSecs = 0;
+    } else {
+        /* first shot right away (see main_loop()) */
+        shotSecs = interval;
+        climateSecs = 0;
+        shotPending = 0;
     }
 
     oldPct = 0xff; // force update
     writeBattery(vccPct);
+    displayWake();
 
     main_state = MAIN_STATE_EMPTY;
 }
 
 static void main_leave(void) {
-    SCD4x_stopPeriodicMeasurement();
+    if (app_interval < APP_INTERVAL_SINGLE_SHOT) SCD4x_stopPeriodicMeasurement();
 }
 
-static void main_loop(void) {
+/* PB3 powers the display as well: it goes blank for a second and is set up
+ * again, the contents are redrawn when the measurement starts over */
+static void main_powerCycle(void) {
+    PORTB &= ~(1 << PB3);   /* power-off all devices */
+    timer_delay(1000);
+    PORTB |= (1 << PB3);    /* the next command waits for the sensor to answer */
+    SSD1306_init();
+    SSD1306_on();
+}
+
+/* recovery steps by stage (1..3): restart only, reinit, power cycle */
+static void (* const recoverSteps[])(void) = { 0, SCD4x_reinit, main_powerCycle };
+
+/* the sensor hangs: next recovery step, then start over (settings are kept by the sensor) */
+static void main_recover(void) {
+    if (recoverStage == 0) stuckSecs = timer_seconds();
+    if (recoverStage < sizeof(recoverSteps) / sizeof(recoverSteps[0])) recoverStage++;
+    main_leave();
+    if (recoverSteps[recoverStage - 1]) recoverSteps[recoverStage - 1]();
+    main_enter();
+    SSD1306_writeString(0, 4, PSTR("SENSOR RESET"), 1);
+    SSD1306_writeInt(13, 4, recoverStage, 10, 0, 0);
+    staleSecs = sameCount = 0;
+}
+
+/* returns the milliseconds until the main loop has something to do again */
+static uint16_t main_loop(void) {
     static const char tickChars[] = {'<','=','>','='};
-    static uint64_t old_ms = 0;
+    static uint16_t old_ms = 0;    /* low 16 bits of timer_millis() (back from the menu, the first second may be late) */
     uint8_t err;
+    uint8_t co2New = 1;
 
     uint8_t btn = button_pressed();
+#if DISPLAY_TIMEOUT > 0
+    if (btn != 0 && displaySecs >= DISPLAY_TIMEOUT) {
+        /* the display is off: the press only switches it back on */
+        displayWake();
+        return 0;
+    }
+#endif
+    if (btn != 0) displayWake();
     if (btn == 1) {
         app_state_next(MENU);
-        return;
+        return 0;
     }
+#ifdef EXPOSURE
+    if (btn == 2 && main_state == MAIN_STATE_RUNNING) {
+        /* long press: switch rows 2-3 between temperature/humidity and the exposure */
+        showExposure ^= 1;
+        SSD1306_clearRows(2, 3);
+        writeLabels();
+        if (showExposure) writeExposure();
+        else writeClimate(SSD1306_FLAG_DOUBLE);
+    }
+#endif
 
-    if (timer_millis() - old_ms >= 1000) {
+    if ((uint16_t)((uint16_t)timer_millis() - old_ms) >= 1000) {
         if (main_state == MAIN_STATE_STARTING) {
-            SSD1306_writeInt(6, 5, 90 - (timer_millis() / 1000), 10, 0, 2);
+            SSD1306_writeInt(6, 5, warmup(), 10, 0, 3);
+        }
+        uint16_t interval = app_intervals[app_interval];
+        err = 0xFF;
+        if (app_interval < APP_INTERVAL_SINGLE_SHOT) {
+            /* periodic measurement: don't ask for data before the next result is due */
+            if (++dataSecs + 1 >= interval) err = SCD4x_getData();
+            if (err == 0) dataSecs = 0;
+        } else {
+            /* single shot mode: a full measurement once per interval, temperature and
+             * humidity only (50ms instead of 5s) every 30 seconds in between */
+            if (shotPending > 0 && (err = SCD4x_getData()) != 0xFF) {
+                co2New = shotPending == 2;
+                shotPending = 0;
+            }
+            if (shotPending == 0 && (shotSecs >= interval || climateSecs == 0)) {
+                shotPending = shotSecs >= interval ? 2 : 1;
+                if (shotPending == 2) shotSecs = climateSecs = 0;
+                SCD4x_measureSingleShot(shotPending == 1);
+            }
+            shotSecs++;
+            if (++climateSecs == 30) climateSecs = 0;
         }
-        err = SCD4x_getData();
+        /* sensor health: new data at least every interval (every 30s with single shots) */
         if (err == 0) {
-            if (main_state == MAIN_STATE_EMPTY) {
-                SSD1306_writeString(4, 3, PSTR("."), 1);
-                SSD1306_writeString(7, 2, PSTR("[C"), 1);   /* '[' is displayed as '°' */
-                SSD1306_writeString(14, 2, PSTR("%"), 1);
-                SSD1306_writeString(14, 3, PSTR("RH"), 1);
-
-                if (main_state == MAIN_STATE_RUNNING || timer_millis() > 90000) {
-                    SSD1306_writeString(0, 5, PSTR("CO2 MAX:"), 1);
-                    SSD1306_writeInt(9, 5, co2max, 10, 0, 0);
+            staleSecs = 0;
+            if (co2New) {
+                if (SCD4x_VALUE_co2 == lastCo2 && SCD4x_VALUE_temp == lastTemp && SCD4x_VALUE_humidity == lastHumidity) {
+                    sameCount++;
                 } else {
-                    SSD1306_writeString(0, 5, PSTR("INIT:"), 1);
-                    SSD1306_writeInt(6, 5, 90 - (timer_millis() / 1000), 10, 0, 2);
+                    sameCount = 0;
                 }
-                SSD1306_writeString(12, 6, PSTR("CO2"), 1);
-                SSD1306_writeString(12, 7, PSTR("PPM"), 1);
+                lastCo2 = SCD4x_VALUE_co2;
+                lastTemp = SCD4x_VALUE_temp;
+                lastHumidity = SCD4x_VALUE_humidity;
+            }
+            if (recoverStage > 0 && sameCount == 0) {
+                /* recovered: show how long it took */
+                recoverStage = 0;
+                SSD1306_writeString(0, 4, PSTR("RECOVERED     S"), 1);
+                SSD1306_writeInt(10, 4, (uint16_t)timer_seconds() - stuckSecs, 10, 0, 4);
+            }
+        } else {
+            staleSecs++;
+        }
+        if (staleSecs > (interval < 30 ? interval : 30) * 2 + 10 || sameCount >= HEALTH_SAME_MAX) {
+            main_recover();
+            return 0;
+        }
+        if (err == 0) {
+            if (main_state == MAIN_STATE_EMPTY) {
+                writeFrame();
                 main_state = MAIN_STATE_STARTING;
             }
-            if (main_state == MAIN_STATE_RUNNING || timer_millis() > 90000) {
-                if (main_state == MAIN_STATE_STARTING) SSD1306_writeString(0, 5, PSTR("CO2 MAX:"), 1);
+            if (main_state == MAIN_STATE_RUNNING || warmup() == 0) {
+                if (main_state == MAIN_STATE_STARTING) SSD1306_writeString(0, 5, PSTR("CO2 MAX: "), 1);
                 main_state = MAIN_STATE_RUNNING;
             }
 
-            if (main_state == MAIN_STATE_RUNNING) {
+            if (main_state == MAIN_STATE_RUNNING && co2New) {
                 if (SCD4x_VALUE_co2 > co2max) co2max = SCD4x_VALUE_co2;
                 SSD1306_writeInt(9, 5, co2max, 10, 0, 0);
             }
             uint8_t flags = SSD1306_FLAG_DOUBLE;
             if (main_state == MAIN_STATE_STARTING) flags |= SSD1306_FLAG_LIGHT;
             SSD1306_writeInt(1, 6, SCD4x_VALUE_co2, 10, flags, 5);
-            SSD1306_writeInt(0, 2, SCD4x_VALUE_temp / 10, 10, flags, 2);
-            SSD1306_writeInt(5, 2, SCD4x_VALUE_temp % 10, 10, flags, 0);
-            SSD1306_writeInt(10, 2, SCD4x_VALUE_humidity, 10, flags, 2);
+            writeClimate(flags);
 
             /* check threshold */
-            if (SCD4x_VALUE_co2 > lastThreshold + 2000) {
+            if (!co2New) {
+                /* temperature and humidity only */
+            } else if (SCD4x_VALUE_co2 > lastThreshold + 2000) {
                 /* beep. */
                 // ... 6000-8000: 1x, 10.000-18.000: 2x, 20.000-24.000 3x, >=24.000: 4x
                 uint8_t cnt = 1;
@@ -133,41 +407,87 @@ static void main_loop(void) {
                 if (SCD4x_VALUE_co2 >= 24000) cnt++;
                 while (cnt-- > 0) {
                     beep(BEEP_WARN);
-                    _delay_ms(200);
+                    beep(BEEP_PAUSE);
                 }
+                displayWake();
 
                 /* update threshold - use 2000ppm steps */
-                lastThreshold = SCD4x_VALUE_co2 - (SCD4x_VALUE_co2 % 2000);
+                while (lastThreshold <= SCD4x_VALUE_co2 - 2000) lastThreshold += 2000;
             } else if (SCD4x_VALUE_co2 < lastThreshold - 2000) {
                 if (belowThresholdSecs > 0) {
-                    belowThresholdSecs -= 5;    /* remember: we have one valid measurement every five seconds! */
+                    /* remember: we have one valid measurement per interval! */
+                    belowThresholdSecs = belowThresholdSecs > interval ? belowThresholdSecs - interval : 0;
                     if (belowThresholdSecs == 0) {
                         /* if less than last threshold for more than 60sec, reduce threshold by 2000ppm */
                         if (lastThreshold >= 6000) lastThreshold -= 2000;
                         beep(BEEP_RELAX);
+                        displayWake();
                     }
                 }
             } else {
-                /* within range of lastThreshold +/- 1999, reset reduce counter */
-                belowThresholdSecs = 60;
+                /* within range of lastThreshold +/- 1999, reset reduce counter: the first
+                 * reading below only starts the minute, so one interval more (at least two
+                 * readings below, 60 seconds apart or more, with any interval) */
+                belowThresholdSecs = 60 + interval;
             }
+#ifdef TREND
+            if (main_state == MAIN_STATE_RUNNING && co2New) {
+                trend_sample(SCD4x_VALUE_co2);
+                writeTrend();
+            }
+#endif
         } else if (err != 0xFF) {
             /* ignore case of 0xff (no data available) */
             SSD1306_writeString(0, 3, PSTR("ERR:       "), 1);
             SSD1306_writeInt(5, 3, err, 16, 0x00, 0);
         }
-        if (tick % 10 == 0) {
+#ifdef TREND
+        trend_second();
+#endif
+#ifdef EXPOSURE
+        /* from the first measurement on (warm-up included: better too high than too low) */
+        if (main_state != MAIN_STATE_EMPTY && exposure_second(SCD4x_VALUE_co2)) writeExposure();
+#endif
+#ifdef LOGGER
+        /* log the latest measurement every LOGGER_INTERVAL seconds (after the warm-up) */
+        if (logSecs < LOGGER_INTERVAL - 1) {
+            logSecs++;
+        } else if (main_state == MAIN_STATE_RUNNING && recoverStage == 0) {
+            logger_append(SCD4x_VALUE_co2, SCD4x_VALUE_temp, SCD4x_VALUE_humidity);
+            logSecs = 0;
+        }
+#endif
+        if (tick == 0 || tick == 10) {
+            /* a display that stopped answering (e.g. loose cable) gets a new init every
+             * ~10 seconds; once it's back, the values follow with the next measurement */
+            if (SSD1306_offline() && SSD1306_init() == 0) {
+                SSD1306_clear();
+                SSD1306_on();
+                displaySecs = 0;    /* full contrast after the init */
+                oldPct = 0xff;      /* battery: redrawn below */
+                if (main_state != MAIN_STATE_EMPTY) writeFrame();
+            }
             /* update VCC display every ~10 seconds */
             uint16_t vcc = VCC_get();
             if (vcc < VCC_MIN) vcc = VCC_MIN;
             else if (vcc > VCC_MAX) vcc = VCC_MAX;
-            vccPct = ((vcc - VCC_MIN) * 100) / (VCC_MAX - VCC_MIN);
+            /* (vcc - VCC_MIN) * 100 / 90 = d * 569 / 2^9 for d = 0..90 (569 = 2^9 + 57) */
+            uint16_t d = vcc - VCC_MIN;
+            vccPct = d + (((d << 5) + (d << 4) + (d << 3) + d) >> 9);
             writeBattery(vccPct);
         }
-        SSD1306_writeChar(15, 0, tickChars[++tick % 4], 0);
+        if (++tick == 20) tick = 0;    /* 0..19: VCC every 10, the spinner every 4 */
+        SSD1306_writeChar(15, 0, tickChars[tick & 3], 0);
+        if (displaySecs < 0xFFFF) displaySecs++;
+        if (displaySecs == DISPLAY_DIM) SSD1306_contrast(DISPLAY_CONTRAST_DIM);
+#if DISPLAY_TIMEOUT > 0
+        if (displaySecs == DISPLAY_TIMEOUT) SSD1306_off();
+#endif
         old_ms = timer_millis();
     }
 
+    uint16_t elapsed = (uint16_t)timer_millis() - old_ms;
+    return elapsed < 1000 ? 1000 - elapsed : 0;
 }
 
 static enum app_state_t app_state = MAINLOOP, app_lastState = MAINLOOP;
@@ -180,12 +500,14 @@ void app_state_next(enum app_state_t next) {
 void app_wakeup(uint8_t initial) {
     uint8_t err;
 
-    /* initialize display */
-    SSD1306_init();
+    /* initialize display (none: warn, the alarms work without it) */
+    if (SSD1306_init() != 0) beep(BEEP_WARN);
     SSD1306_clear();
     SSD1306_on();
 
+#ifndef LOGGER
     SSD1306_writeImg(5, 1, splash_width, splash_height, splash_data, 2);
+#endif
     SSD1306_writeString(0, 5, app_version, SSD1306_FLAG_PGM);
 
     /* beep. */
@@ -195,27 +517,30 @@ void app_wakeup(uint8_t initial) {
         SSD1306_writeInt(14, 0, err, 16, 0x00, 0);
     }
 
-    /* detect sensor type */
+    /* detect sensor type (no answer: retry in I2C standard mode for long or noisy wiring) */
     scd4x_sensor_type_t sensorType = SCD4x_getSensorType();
-    if (sensorType == SCD4x_SENSOR_SCD40) {
-        SSD1306_writeString(0, 6, PSTR("SCD40"), 1);
-    } else if (sensorType == SCD4x_SENSOR_SCD41) {
-        SSD1306_writeString(0, 6, PSTR("SCD41"), 1);
-    } else if (sensorType == SCD4x_SENSOR_ERROR) {
+    if (sensorType == SCD4x_SENSOR_ERROR) {
+        i2c_speed(I2C_STANDARD);
+        sensorType = SCD4x_getSensorType();
+    }
+    if (sensorType == SCD4x_SENSOR_ERROR) {
         SSD1306_writeString(0, 6, PSTR("ERROR"), 1);
-        while(1);
-    } else {
-        SSD1306_writeString(0, 6, PSTR("UNKNW"), 1);
-        while(1);
+        while(1) sleep_mode();  /* until the watchdog restarts us: try again */
     }
+    SSD1306_writeString(0, 6, sensorType == SCD4x_SENSOR_SCD41 ? PSTR("SCD41") : PSTR("SCD40"), 1);
 
     {
         SSD1306_writeString(7, 6, PSTR("VCC 0.00V"), 1);
         uint16_t vcc = VCC_get();
         uint8_t x;
-        x = SSD1306_writeInt(11, 6, vcc / 100, 10, 0x00, 0);
+        uint8_t volts = 0;
+        while (vcc >= 100) {    /* vcc is in 1/100 V: count the volts off */
+            vcc -= 100;
+            volts++;
+        }
+        x = SSD1306_writeInt(11, 6, volts, 10, 0x00, 0);
         //SSD1306_writeChar(x++, 5, '.', 0x00);
-        x = SSD1306_writeInt(++x, 6, vcc % 100, 10, SSD1306_FLAG_FILL_ZERO, 2);
+        x = SSD1306_writeInt(++x, 6, vcc, 10, SSD1306_FLAG_FILL_ZERO, 2);
         //SSD1306_writeChar(x++, 5, 'V', 0x00);
     }
 
@@ -253,8 +578,18 @@ void app_wakeup(uint8_t initial) {
     lastThreshold = 2000;
     belowThresholdSecs = 0;
     co2max = 0;
+#ifdef TREND
+    trendWarned = 0;
+#endif
+#ifdef EXPOSURE
+    exposure_reset();
+    exposureOver = 0;
+#endif
+#ifdef LOGGER
+    logger_init();      /* the next record starts a new session */
+#endif
 
-    _delay_ms(3000);
+    timer_delay(3000);
 }
 
 int main(void) {
@@ -273,11 +608,17 @@ int main(void) {
     /* initialize I²C bus */
     i2c_init();
 
+#ifdef INTERVALS
+    app_interval = eeprom_read_byte(&app_interval_ee);
+    if (app_interval >= APP_INTERVAL_COUNT) app_interval = 0;   /* erased EEPROM */
+#endif
+
     app_wakeup(1);
 
     main_enter();
 
     for (;;) {
+        uint16_t idle = 0;
         button_read();
         if (app_lastState != app_state) {
             // state transition
@@ -292,9 +633,15 @@ int main(void) {
             app_lastState = app_state;
         }
         switch (app_state) {
-            case MAINLOOP: main_loop(); break;
-            case MENU: menu_loop(); break;
+            case MAINLOOP: idle = main_loop(); break;
+            case MENU: idle = menu_loop(); break;
         }
 
+        /* sleep until the next thing to do; only idle sleep (timer0 keeps running)
+         * while the button needs debouncing or a melody is playing (timer1) */
+        cli();
+        if (!button_idle() || beep_busy()) idle = 0;
+        timer_sleep(idle);
+
     }
 }
@@ -9,6 +9,7 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
+#include <avr/eeprom.h>
 #include <avr/pgmspace.h>
 
 enum app_state_t {
@@ -16,6 +17,20 @@ enum app_state_t {
     MENU
 };
 
+/* measurement intervals: periodic (5s), low power periodic (30s),
+ * single shots every 1min or 5min (SCD41 only, build with -DINTERVALS=ON) */
+#ifdef INTERVALS
+#define APP_INTERVAL_COUNT          4
+#define APP_INTERVAL_SINGLE_SHOT    2   /* first interval using single shots */
+extern uint8_t app_interval;
+extern uint8_t EEMEM app_interval_ee;
+#else
+#define APP_INTERVAL_COUNT          1   /* periodic measurement only */
+#define APP_INTERVAL_SINGLE_SHOT    1
+#define app_interval                0
+#endif
+extern const uint16_t app_intervals[APP_INTERVAL_COUNT];   /* seconds */
+
 extern const char app_version[] PROGMEM;
 void app_state_next(enum app_state_t next);
 void app_wakeup(uint8_t initial);
@@ -12,31 +12,78 @@
 #include <avr/pgmspace.h>
 #include <avr/power.h>
 #include <avr/sleep.h>
-#include <util/delay.h>
 #include "SCD4x.h"
 #include "SSD1306.h"
 #include "beep.h"
 #include "button.h"
 #include "main.h"
 #include "timer.h"
+#include "logger.h"
+#include "dock.h"
 #include "menu.h"
 
 #include "i2cmaster.h"
 
+/* the menu rows, the 9th one (if any) scrolls in below BACK */
+enum menu_entry_t {
+    MENU_ASC,
+    MENU_CALIBRATE,
+    MENU_ALTITUDE,
+    MENU_SELFTEST,
+    MENU_VOLUME,
+#ifdef INTERVALS
+    MENU_INTERVAL,
+#endif
+    MENU_POWEROFF,
+    MENU_BACK,
+#ifdef LOGGER
+    MENU_EXPORT,
+#endif
+    MENU_ENTRIES
+};
+
 static uint8_t cursor;
 static scd4x_asc_enabled_t asc_status = SCD4x_ASC_UNKNOWN;
-static uint64_t timeout_ms;
+static uint16_t timeout_ms;    /* low 16 bits of timer_millis(): the menu times out after 10 seconds */
 static uint16_t altitude;
 
-static void do_asc(void) {
-    // toggle ASC setting
-    SCD4x_setAutomaticSelfCalibration(asc_status == SCD4x_ASC_DISABLED ? SCD4x_ASC_ENABLED : SCD4x_ASC_DISABLED);
+/* the menu rows, each one terminated by '\0' */
+static const char menu_labels[] PROGMEM =
+    "AUTO-CALIB:\0" "FORCE CALIBRATE\0" "ALTITUDE:\0" "SELF TEST\0" "VOLUME\0"
+#ifdef INTERVALS
+    "INTERVAL:     S\0"
+#endif
+    "POWER OFF\0" "BACK"
+#if defined(LOGGER) && !defined(INTERVALS)
+    "\0" "EXPORT LOG"
+#endif
+    ;
+
+/* waits for the next button press (1: short, 2: long), 0 after timeoutMillis without one (0: no timeout) */
+static uint8_t menu_button(uint16_t timeoutMillis) {
+    uint16_t start = timer_millis();
+    while(1) {
+        button_read();
+        uint8_t btn = button_pressed();
+        if (btn > 0) return btn;
+        if (timeoutMillis > 0 && (uint16_t)((uint16_t)timer_millis() - start) > timeoutMillis) return 0;
+        timer_sleep(0);
+    }
+}
+
+static void show_asc(void) {
     asc_status = SCD4x_getAutomaticSelfCalibration();
     switch (asc_status) {
         case SCD4x_ASC_DISABLED: SSD1306_writeString(13, 0, PSTR("OFF"), 1); break;
         case SCD4x_ASC_ENABLED: SSD1306_writeString(13, 0, PSTR("ON "), 1); break;
-        default: SSD1306_writeString(13, 1, PSTR("???"), 1); break;
+        default: SSD1306_writeString(13, 0, PSTR("???"), 1); break;
     }
+}
+
+static void do_asc(void) {
+    // toggle ASC setting
+    SCD4x_setAutomaticSelfCalibration(asc_status == SCD4x_ASC_DISABLED ? SCD4x_ASC_ENABLED : SCD4x_ASC_DISABLED);
+    show_asc();
     if (asc_status != SCD4x_ASC_UNKNOWN) SCD4x_persistSettings();
 }
 
@@ -46,50 +93,44 @@ static void do_forced_recalibration(void) {
     SSD1306_writeString(0, 1, PSTR("TO 420 PPM CO2 ?"), 1);
     SSD1306_writeString(1, 3, PSTR("CONTINUE"), 1);
     SSD1306_writeString(0, 4, PSTR("*CANCEL"), 1);
-    timeout_ms = timer_millis();
     uint8_t subCursor = 1;
     while(1) {
-        button_read();
-        uint8_t btn = button_pressed();
+        /* cancel after 5 seconds without a button press */
+        uint8_t btn = menu_button(5000);
+        if (btn == 0) return;
         if (btn == 1) {
             SSD1306_writeString(0, 3+subCursor, PSTR(" "), 1);
             subCursor++;
             subCursor %= 2; /* if (subCursor == 2) subCursor = 0; */
             SSD1306_writeString(0, 3+subCursor, PSTR("*"), 1);
-        } else if (btn == 2) {
+        } else {
             // long press...
             if (subCursor == 1) return;
             // else: do recalibration...
             SSD1306_writeString(1, 3, PSTR("SAVING..."), 1);
-            _delay_ms(500);
             uint16_t res = SCD4x_performForcedRecalibration();
             SSD1306_writeString(1, 3, PSTR("DONE:    "), 1);
-            SSD1306_writeInt(7, 3, (int32_t)res - 0x8000, 10, 0x00, 0);
-            _delay_ms(2000);
+            /* the correction in ppm, offset by 0x8000 (0xFFFF: failed) */
+            uint8_t x = 7;
+            if (res < 0x8000) SSD1306_writeChar(x++, 3, '-', 0x00);
+            SSD1306_writeInt(x, 3, res < 0x8000 ? 0x8000 - res : res - 0x8000, 10, 0x00, 0);
+            timer_delay(2000);
             return;
         }
-        if (timer_millis() - timeout_ms > 5000) return;
     }
 }
 
 static void do_altitude(void) {
     SSD1306_writeInt(11, 2, altitude, 10, 0x02, 4);
-    while(1) {
-       button_read();
-       uint8_t btn = button_pressed();
-       if (btn == 1) {
-           // increase & update value
-           altitude += 100;
-           if (altitude > 3000) altitude = 0;
-           SSD1306_writeInt(11, 2, altitude, 10, 0x02, 4);
-       } else if (btn == 2) {
-           // save new altitude
-           SCD4x_setSensorAltitude(altitude);
-           SCD4x_persistSettings();
-           // leave loop
-           break;
-       }
+    while (menu_button(0) == 1) {
+        // increase & update value
+        altitude += 100;
+        if (altitude > 3000) altitude = 0;
+        SSD1306_writeInt(11, 2, altitude, 10, 0x02, 4);
     }
+    // long press: save new altitude
+    SCD4x_setSensorAltitude(altitude);
+    SCD4x_persistSettings();
     // write non-inverted
     SSD1306_writeInt(11, 2, altitude, 10, 0x00, 4);
 }
@@ -97,8 +138,15 @@ static void do_altitude(void) {
 static void do_selftest(void) {
     SSD1306_clear();
     SSD1306_writeString(0, 0, PSTR("TESTING..."), 1);
-    uint16_t status = SCD4x_performSelfTest();
-    SSD1306_writeString(0, 0, PSTR("DONE.     "), 1);
+    SCD4x_startSelfTest();
+    uint32_t start = timer_seconds();
+    while (SCD4x_busy()) {
+        /* count down the seconds while the sensor is busy */
+        SSD1306_writeInt(11, 0, 10 - (timer_seconds() - start), 10, 0x00, 2);
+        timer_sleep(0);
+    }
+    uint16_t status = SCD4x_getResult();
+    SSD1306_writeString(0, 0, PSTR("DONE.        "), 1);
     SSD1306_writeString(0, 1, PSTR("STATUS:"), 1);
     if (status == 0) {
         SSD1306_writeString(8, 1, PSTR("OK"), 1);
@@ -106,37 +154,41 @@ static void do_selftest(void) {
         SSD1306_writeString(8, 1, PSTR("ERR"), 1);
         SSD1306_writeInt(12, 1, status, 16, 0x00, 0);
     }
-    _delay_ms(2000);
+    timer_delay(2000);
 }
 
 static void do_poweroff(void) {
-    uint64_t btn_ts;
-
     SSD1306_clear();
     SSD1306_writeString(0, 0, PSTR("-- POWER OFF --"), 1);
     SCD4x_powerDown();
-    _delay_ms(500);
+    timer_delay(500);
     beep(BEEP_SHUTDOWN);
-    _delay_ms(1000);
+    beep_wait();    /* timer1 stops in power-down */
+    timer_delay(1000);
     SSD1306_off();
     PORTB &= ~(1 << PB3);    /* power-off all devices */
 
 DO_SLEEP:
+#ifdef DOCK
+    dock_listen();  /* a reader on the bus wakes us up, too */
+#endif
     set_sleep_mode(SLEEP_MODE_PWR_DOWN);
     power_all_disable();
+#ifdef DOCK
+    power_usi_enable();
+#endif
+    timer_watchdog(0);  /* sleeping for good, not hanging */
     sleep_mode();
 
     /* when we get here, we've been woken up */
     power_all_enable();
     timer_reset();
+    timer_watchdog(1);
+#ifdef DOCK
+    if (dock_run()) goto DO_SLEEP;
+#endif
     button_reset();
-    btn_ts = timer_millis();
-    while(1) {
-        button_read();
-        uint8_t btn = button_pressed();
-        if (btn == 2) break;    // long press
-        if (timer_millis() - btn_ts > 2000) goto DO_SLEEP;
-    }
+    if (menu_button(2000) != 2) goto DO_SLEEP;  // only a long press powers on
 
     PORTB |= (1 << PB3);    /* power-on all devices */
 
@@ -150,93 +202,132 @@ DO_SLEEP:
 static void do_volume(void) {
 UPDATE_VOL:
     SSD1306_writeInt(15, 4, beep_volume, 10, SSD1306_FLAG_INVERTED, 0);
-    while(1) {
-        button_read();
-        uint8_t btn = button_pressed();
-        if (btn == 1) {
-            /* increase & update value */
-            beep_volume++;
-            if (beep_volume > 3) beep_volume = 0;
-            /* SSD1306_writeInt(15, 4, beep_volume, 10, SSD1306_FLAG_INVERTED, 0); */
-            beep(BEEP_RELAX);
-            goto UPDATE_VOL; /* saves 24 byte */
-        } else if (btn == 2) {
-            /* save new volume in EEPROM */
-            // ToDo ###IMPLEMENT###
-            /* leave loop */
-            break;
-        }
+    if (menu_button(0) == 1) {
+        /* increase & update value */
+        beep_volume++;
+        if (beep_volume > 3) beep_volume = 0;
+        beep(BEEP_RELAX);
+        goto UPDATE_VOL; /* saves 24 byte */
     }
+    /* long press: save new volume in EEPROM */
+    // ToDo ###IMPLEMENT###
     /* write non-inverted */
     SSD1306_writeInt(15, 4, beep_volume, 10, 0x00, 0);
 }
 
+#ifdef INTERVALS
+static void do_interval(void) {
+    /* single shot measurements are not supported by the SCD40 */
+    uint8_t count = SCD4x_getSensorType() == SCD4x_SENSOR_SCD41 ? APP_INTERVAL_COUNT : APP_INTERVAL_SINGLE_SHOT;
+UPDATE_INTERVAL:
+    SSD1306_writeInt(12, 5, app_intervals[app_interval], 10, SSD1306_FLAG_INVERTED, 3);
+    if (menu_button(0) == 1) {
+        app_interval++;
+        if (app_interval >= count) app_interval = 0;
+        goto UPDATE_INTERVAL;
+    }
+    /* long press: save new interval in EEPROM */
+    eeprom_update_byte(&app_interval_ee, app_interval);
+    SSD1306_writeInt(12, 5, app_intervals[app_interval], 10, 0x00, 3);
+}
+#endif
+
+#ifdef LOGGER
+static void do_export(void) {
+    SSD1306_clear();
+    SSD1306_writeString(0, 0, PSTR("EXPORTING..."), 1);
+    uint16_t n = logger_export();
+    SSD1306_writeString(0, 0, PSTR("DONE.        "), 1);
+    SSD1306_writeString(0, 1, PSTR("RECORDS:"), 1);
+    SSD1306_writeInt(9, 1, n, 10, 0x00, 0);
+    timer_delay(2000);
+}
+#endif
+
 void menu_enter(void) {
     SSD1306_clear();
-    SSD1306_writeString(1, 0, PSTR("AUTO-CALIB:"), 1);
-    asc_status = SCD4x_getAutomaticSelfCalibration();
-    switch (asc_status) {
-        case SCD4x_ASC_DISABLED: SSD1306_writeString(13, 0, PSTR("OFF"), 1); break;
-        case SCD4x_ASC_ENABLED: SSD1306_writeString(13, 0, PSTR("ON"), 1); break;
-        default: SSD1306_writeString(13, 0, PSTR("???"), 1); break;
+    const char *label = menu_labels;
+    for (uint8_t row = 0; row < (MENU_ENTRIES > 8 ? 8 : MENU_ENTRIES); row++) {
+        /* from column 1, the end column returned is the label length + 1: the next label */
+        label += SSD1306_writeString(1, row, label, 1);
     }
-    SSD1306_writeString(1, 1, PSTR("FORCE CALIBRATE"), 1);
-    SSD1306_writeString(1, 2, PSTR("ALTITUDE:"), 1);
+    SSD1306_writeInt(15, 4, beep_volume, 10, 0x00, 0);
+#ifdef INTERVALS
+    SSD1306_writeInt(12, 5, app_intervals[app_interval], 10, 0x00, 3);
+#endif
+    cursor = MENU_POWEROFF;
+    SSD1306_writeString(0, MENU_BACK, PSTR("*"), 1);
+
+    /* sensor values last: they have to wait until stop_periodic_measurement has finished */
+    show_asc();
     altitude = SCD4x_getSensorAltitude();
     SSD1306_writeInt(11, 2, altitude, 10, 0x00, 4);
-
-    SSD1306_writeString(1, 3, PSTR("SELF TEST"), 1);
-    SSD1306_writeString(1, 4, PSTR("VOLUME"), 1);
-    SSD1306_writeInt(15, 4, beep_volume, 10, 0x00, 0);
-    SSD1306_writeString(1, 5, PSTR("POWER OFF"), 1);
-    SSD1306_writeString(1, 6, PSTR("BACK"), 1);
-    cursor = 5;
-    SSD1306_writeString(0, 6, PSTR("*"), 1);
     timeout_ms = timer_millis();
 }
 
-void menu_loop(void) {
+/* returns the milliseconds until the menu has something to do again */
+uint16_t menu_loop(void) {
     uint8_t btn = button_pressed();
     if (btn > 0) timeout_ms = timer_millis();
     if (btn == 1) {
-        SSD1306_writeString(0, cursor, PSTR(" "), 1);
+        SSD1306_writeString(0, cursor > 7 ? 7 : cursor, PSTR(" "), 1);
         cursor++;
-        cursor %= 7; /* if (cursor == 6) cursor = 0; */
-        SSD1306_writeString(0, cursor, PSTR("*"), 1);
+        if (cursor == MENU_ENTRIES) cursor = 0;
+#if defined(LOGGER) && defined(INTERVALS)
+        /* no 9th row: EXPORT LOG scrolls in below BACK */
+        if (cursor == 8) SSD1306_writeString(1, 7, PSTR("EXPORT LOG"), 1);
+        if (cursor == 0) SSD1306_writeString(1, 7, PSTR("BACK      "), 1);
+#endif
+        SSD1306_writeString(0, cursor > 7 ? 7 : cursor, PSTR("*"), 1);
     } else if (btn == 2) {
-        if (cursor == 0) {
+        if (cursor == MENU_ASC) {
             // set ASC
             do_asc();
             timeout_ms = timer_millis();
-        } else if (cursor == 1) {
+        } else if (cursor == MENU_CALIBRATE) {
             // force calibration
             do_forced_recalibration();
             menu_enter();
-        } else if (cursor == 2) {
+        } else if (cursor == MENU_ALTITUDE) {
             // set altitude test
             do_altitude();
             timeout_ms = timer_millis();
-        } else if (cursor == 3) {
+        } else if (cursor == MENU_SELFTEST) {
             // self test
             do_selftest();
             menu_enter();
-        } else if (cursor == 4) {
+        } else if (cursor == MENU_VOLUME) {
             /* change volume */
             do_volume();
             menu_enter();
-        } else if (cursor == 5) {
+#ifdef INTERVALS
+        } else if (cursor == MENU_INTERVAL) {
+            /* measurement interval */
+            do_interval();
+            timeout_ms = timer_millis();
+#endif
+        } else if (cursor == MENU_POWEROFF) {
             // power off
             do_poweroff();
             // returning here means, device was woken up
             app_state_next(MAINLOOP);
-        } else if (cursor == 6) {
+        } else if (cursor == MENU_BACK) {
             // back
             app_state_next(MAINLOOP);
+#ifdef LOGGER
+        } else if (cursor == MENU_EXPORT) {
+            /* send the data log through the buzzer */
+            do_export();
+            app_state_next(MAINLOOP);
+#endif
         }
-        return;
+        return 0;
     }
-    if (timer_millis() - timeout_ms > 10000) {
+    uint16_t elapsed = (uint16_t)timer_millis() - timeout_ms;
+    if (elapsed > 10000) {
         // timeout
         app_state_next(MAINLOOP);
+        return 0;
     }
+    return 10000 - elapsed;
 }
@@ -11,6 +11,6 @@
 #define _MENU_H
 
 void menu_enter(void);
-void menu_loop(void);
+uint16_t menu_loop(void);
 
 #endif // _MENU_H
@@ -0,0 +1,113 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: I2C throughput benchmark (-B)
+ * Runs a full SSD1306_clear(), a row of SSD1306_writeChar(), a double size
+ * number (as the CO₂ value) and a SCD4x_getData() round trip through the
+ * firmware drivers in each bus speed mode and reports the achieved rate and
+ * the CPU cycles spent. Of the cycles spent on characters, the share for
+ * reading the font tells the EEPROM and the flash (-DFONT_PROGMEM=ON) font
+ * apart; arithmetic is not counted by the simulator.
+ */
+
+#include <avr/io.h>
+#include "i2cmaster.h"
+#include "timer.h"
+#include "SCD4x.h"
+#include "SSD1306.h"
+#include "sim.h"
+
+typedef struct {
+    uint64_t bytes;     /* bytes on the bus, including address bytes */
+    uint64_t bus_ns;
+    uint64_t ns;        /* wall time, including the sensor's execution time */
+    uint64_t cycles;    /* CPU cycles (busy-waits included) */
+    uint64_t font;      /* ... of those reading the EEPROM or flash */
+} bench_t;
+
+#ifdef I2C_USI
+#define BACKEND "usimaster.c"
+#else
+#define BACKEND "i2cmaster.S"
+#endif
+
+#ifdef FONT_PROGMEM
+#define FONT "flash"
+#else
+#define FONT "EEPROM"
+#endif
+
+static void bench_start(bench_t *b) {
+    b->bytes = sim_i2c_bytes();
+    b->bus_ns = sim_i2c_bus_ns();
+    b->ns = sim_now_ns;
+    b->cycles = sim_stats.cycles_active;
+    b->font = sim_stats.cycles_eeprom + sim_stats.cycles_flash;
+}
+
+static void bench_stop(bench_t *b) {
+    b->bytes = sim_i2c_bytes() - b->bytes;
+    b->bus_ns = sim_i2c_bus_ns() - b->bus_ns;
+    b->ns = sim_now_ns - b->ns;
+    b->cycles = sim_stats.cycles_active - b->cycles;
+    b->font = sim_stats.cycles_eeprom + sim_stats.cycles_flash - b->font;
+}
+
+static void bench_per_char(FILE *f, const char *name, const bench_t *b, uint8_t n) {
+    fprintf(f, "  %-16s %8.3fms bus time, %6llu CPU cycles, %4llu reading the font\n", name, b->bus_ns / 1e6 / n,
+            (unsigned long long)b->cycles / n, (unsigned long long)b->font / n);
+}
+
+static void bench_print(FILE *f, const char *name, const bench_t *b) {
+    fprintf(f, "  %-16s %5llu bytes, %8.3fms bus time, %7.0f bytes/s (%3.0f kHz), %8.3fms total\n",
+            name, (unsigned long long)b->bytes, b->bus_ns / 1e6, b->bytes * 1e9 / b->bus_ns,
+            b->bytes * 9e6 / b->bus_ns, b->ns / 1e6);
+}
+
+void sim_bench(FILE *f) {
+    static const char *modes[2] = {"standard mode", "fast mode"};
+    bench_t b;
+
+    timer_init();
+    i2c_init();
+    DDRB |= (1 << DDB3);    /* sensor and display power */
+    PORTB |= (1 << PB3);
+    timer_delay(50);
+    SSD1306_init();
+    SCD4x_startPeriodicMeasurement();
+
+    fprintf(f, "i2c benchmark (%s, font in %s) at F_CPU_FAST = %.0f MHz\n", BACKEND, FONT, F_CPU_FAST / 1e6);
+    for (uint8_t fast = 0; fast < 2; fast++) {
+        i2c_speed(fast ? I2C_FAST : I2C_STANDARD);
+        fprintf(f, "%s:\n", modes[fast]);
+
+        bench_start(&b);
+        SSD1306_clear();
+        bench_stop(&b);
+        bench_print(f, "SSD1306_clear()", &b);
+
+        /* 16 different characters, so none is skipped by the cell cache */
+        bench_start(&b);
+        for (uint8_t x = 0; x < 16; x++) SSD1306_writeChar(x, 0, 'A' + x, 0);
+        bench_stop(&b);
+        bench_print(f, "SSD1306_writeChar", &b);
+        bench_per_char(f, "per character", &b, 16);
+
+        /* 4 double size digits, all of them different from the last run */
+        bench_start(&b);
+        SSD1306_writeString(0, 2, fast ? "5678" : "1234", SSD1306_FLAG_DOUBLE);
+        bench_stop(&b);
+        bench_print(f, "double digits", &b);
+        bench_per_char(f, "per digit", &b, 4);
+
+        /* wait for the next measurement */
+        timer_delay(5000);
+        bench_start(&b);
+        uint8_t err = SCD4x_getData();
+        bench_stop(&b);
+        if (err != 0) fprintf(f, "  SCD4x_getData() failed: 0x%02x\n", err);
+        else bench_print(f, "SCD4x_getData()", &b);
+    }
+}
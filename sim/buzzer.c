@@ -0,0 +1,93 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: sound transducer on OC1B, recorded as WAV file
+ * Every timer1 period is rendered as one cycle of a square wave (high while
+ * the counter is below OCR1B). Silence longer than BUZZER_MAX_PAUSE_NS is
+ * shortened, so a recording of hours only holds the sounds. The notes are
+ * counted (a sound after at least one silent period, or a change of pitch),
+ * to check alarms.
+ */
+
+#include <stdio.h>
+#include "sim.h"
+
+#define BUZZER_RATE         48000
+#define BUZZER_LEVEL        12000
+#define BUZZER_MAX_PAUSE_NS 500000000ULL
+
+static FILE *wav = NULL;
+static uint32_t samples = 0;        /* samples written */
+static uint64_t offset_ns = 0;      /* simulated time skipped in pauses */
+static uint32_t notes = 0;
+static uint64_t last_end_ns = 0;    /* end of the last sounding period ... */
+static uint64_t last_period_ns = 0; /* ... and its length */
+
+static void put_le(uint32_t v, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) fputc((v >> (8 * i)) & 0xFF, wav);
+}
+
+static void header(void) {
+    fseek(wav, 0, SEEK_SET);
+    fputs("RIFF", wav);
+    put_le(36 + samples * 2, 4);
+    fputs("WAVEfmt ", wav);
+    put_le(16, 4);
+    put_le(1, 2);                   /* PCM */
+    put_le(1, 2);                   /* mono */
+    put_le(BUZZER_RATE, 4);
+    put_le(BUZZER_RATE * 2, 4);
+    put_le(2, 2);
+    put_le(16, 2);
+    fputs("data", wav);
+    put_le(samples * 2, 4);
+}
+
+int sim_buzzer_open(const char *path) {
+    wav = fopen(path, "wb");
+    if (wav == NULL) return -1;
+    header();
+    return 0;
+}
+
+/* time of the next sample on the simulated clock */
+static uint64_t sample_ns(void) {
+    return offset_ns + (uint64_t)samples * 1000000000ULL / BUZZER_RATE;
+}
+
+/* samples until end: silence before start, then a square wave high for high_ns */
+static void render(uint64_t start, uint64_t end, uint64_t high_ns) {
+    if (sample_ns() + BUZZER_MAX_PAUSE_NS < start) offset_ns = start - BUZZER_MAX_PAUSE_NS - sample_ns() + offset_ns;
+    for (uint64_t t = sample_ns(); t < end; t = sample_ns()) {
+        int16_t v = 0;
+        if (t >= start && high_ns > 0) v = t - start < high_ns ? BUZZER_LEVEL : -BUZZER_LEVEL;
+        put_le((uint16_t)v, 2);
+        samples++;
+    }
+}
+
+/* one timer1 period ending now */
+void sim_buzzer_period(uint64_t period_ns, uint64_t high_ns) {
+    if (high_ns > 0) {
+        if (sim_now_ns - period_ns > last_end_ns + period_ns || last_period_ns != period_ns) notes++;
+        last_end_ns = sim_now_ns;
+        last_period_ns = period_ns;
+    }
+    if (wav != NULL) render(sim_now_ns - period_ns, sim_now_ns, high_ns);
+}
+
+uint32_t sim_buzzer_notes(void) {
+    return notes;
+}
+
+void sim_buzzer_close(void) {
+    if (wav == NULL) return;
+    /* the silence after the last sound */
+    uint64_t end = sample_ns() + BUZZER_MAX_PAUSE_NS;
+    render(end, end < sim_now_ns ? end : sim_now_ns, 0);
+    header();
+    fclose(wav);
+    wav = NULL;
+}
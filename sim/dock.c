@@ -0,0 +1,260 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: reader in the dock, an I2C master on the bus lines
+ * Stand-in for the docking station (see dock.h): it drives SCL and SDA at
+ * 100kHz through the bus model in usi.c and honors clock stretching. Once
+ * docked it polls the device every second until it answers, then reads the
+ * identification and settings registers, optionally writes the measurement
+ * interval, streams the log in chunks and checks the CRC of every frame.
+ */
+
+#include <avr/io.h>
+#include "dock.h"
+#include "logger.h"
+#include "sim.h"
+
+#define SDA PB0
+#define SCL PB2
+
+#define HALF_NS     5000ULL         /* half SCL period (100kHz) */
+#define RETRY_NS    1000000000ULL   /* device didn't answer: poll again */
+#define CHUNK       32              /* bytes per read transaction */
+#define STRETCH_MAX_NS  25000000ULL /* SCL held low for longer (as the SMBus timeout): give up */
+
+static uint64_t next_ns = UINT64_MAX;
+static int interval = -1;           /* write DOCK_REG_INTERVAL (-1: don't) */
+
+/* jobs, each one transaction */
+static enum {
+    JOB_POINTER,    /* set the pointer to DOCK_REG_ID */
+    JOB_REGS,       /* read DOCK_REG_ID..DOCK_REG_VOLUME */
+    JOB_INTERVAL,   /* write DOCK_REG_INTERVAL */
+    JOB_LOG,        /* set the pointer to DOCK_REG_LOG */
+    JOB_STREAM,     /* read the log, CHUNK bytes at a time */
+    JOB_DONE,
+} job = JOB_POINTER;
+
+/* the current transaction: address, tx_len bytes written, then rx_want bytes read */
+static uint8_t addr, tx[2], tx_len, rx[CHUNK], rx_want, rx_len;
+static enum { BUS_START, BUS_SCL_LOW, BUS_LOW, BUS_RISE, BUS_HIGH, BUS_STOP, BUS_STOP_SCL, BUS_STOP_SDA } phase;
+static uint8_t pos, bit, out, shift, nack;
+
+/* results */
+static uint8_t regs[DOCK_REGS];
+static uint8_t frame[LOGGER_EXPORT_FRAME], frame_len;
+static unsigned records, crc_errors, expected, ended;
+static uint8_t docked, answered;
+static uint64_t docked_ns, answered_ns, done_ns, stretch_ns, stretch_since;
+static uint32_t polls, transactions, bytes;
+
+static uint8_t crc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0xFF;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+static void transaction(uint8_t read, uint8_t len) {
+    addr = (DOCK_ADDRESS << 1) | read;
+    tx_len = read ? 0 : len;
+    rx_want = read ? len : 0;
+    rx_len = 0;
+    nack = 0;
+    phase = BUS_START;
+    transactions++;
+}
+
+void sim_dock_at(uint64_t at_ns, int set_interval) {
+    docked = 1;
+    docked_ns = next_ns = at_ns;
+    interval = set_interval;
+    tx[0] = DOCK_REG_ID;
+    transaction(0, 1);
+}
+
+uint64_t sim_dock_next_ns(void) {
+    return next_ns;
+}
+
+static void stream_byte(uint8_t b) {
+    if (frame_len == 0 && b == 0xFF) {
+        /* end of the stream without an end frame */
+        ended = 1;
+        return;
+    }
+    frame[frame_len++] = b;
+    if (frame_len < LOGGER_EXPORT_FRAME) return;
+    frame_len = 0;
+    if (crc8(frame, LOGGER_EXPORT_FRAME - 1) != frame[LOGGER_EXPORT_FRAME - 1]) {
+        crc_errors++;
+    } else if (frame[0] == LOGGER_EXPORT_RECORD) {
+        printf("dock:  %4u  %5u ppm %5.1f C %3u %%RH%s%s\n", records++, frame[1] | (frame[2] << 8),
+               (int16_t)(frame[3] | (frame[4] << 8)) / 10.0, frame[5],
+               (frame[6] & LOGGER_FLAG_SESSION) ? "  (power-on)" : "", (frame[6] & LOGGER_FLAG_GAP) ? "  (gap)" : "");
+    } else if (frame[0] == LOGGER_EXPORT_END) {
+        expected = frame[1] | (frame[2] << 8);
+        ended = 1;
+    }
+}
+
+/* a transaction has ended with the stop condition: next job */
+static void transaction_done(void) {
+    if (sim_log != NULL) {
+        fprintf(sim_log, "dock: %s %u bytes%s\n", (addr & 1) ? "read" : "write", (addr & 1) ? rx_len : tx_len,
+                nack ? " (NACK)" : "");
+    }
+    next_ns = sim_now_ns + HALF_NS;
+    if (nack) {
+        /* not answering (switched on, or waking up): poll again */
+        polls++;
+        next_ns = sim_now_ns + RETRY_NS;
+        transactions--;
+        transaction(addr & 1, (addr & 1) ? rx_want : tx_len);
+        return;
+    }
+    bytes += tx_len + rx_len;
+    switch (job) {
+        case JOB_POINTER:
+            if (!answered) answered_ns = sim_now_ns;
+            answered = 1;
+            job = JOB_REGS;
+            transaction(1, DOCK_REGS);
+            break;
+        case JOB_REGS:
+            for (uint8_t i = 0; i < DOCK_REGS; i++) regs[i] = rx[i];
+            if (interval >= 0) {
+                job = JOB_INTERVAL;
+                tx[0] = DOCK_REG_INTERVAL;
+                tx[1] = interval;
+                transaction(0, 2);
+                break;
+            }
+            /* fall through */
+        case JOB_INTERVAL:
+            job = JOB_LOG;
+            tx[0] = DOCK_REG_LOG;
+            transaction(0, 1);
+            break;
+        case JOB_LOG:
+            job = JOB_STREAM;
+            transaction(1, CHUNK);
+            break;
+        case JOB_STREAM:
+            for (uint8_t i = 0; i < rx_len && !ended; i++) stream_byte(rx[i]);
+            if (ended || !(regs[DOCK_REG_STATUS] & DOCK_STATUS_LOGGER)) {
+                /* undocked */
+                job = JOB_DONE;
+                done_ns = sim_now_ns;
+                next_ns = UINT64_MAX;
+                sim_usi_external(1, 1);
+            } else {
+                transaction(1, CHUNK);
+            }
+            break;
+        case JOB_DONE:
+            break;
+    }
+}
+
+/* SCL held low by the device: wait, or give up the transaction after STRETCH_MAX_NS */
+static uint8_t stretched(uint8_t scl) {
+    if (scl) {
+        stretch_since = 0;
+        return 0;
+    }
+    if (stretch_since == 0) stretch_since = sim_now_ns;
+    next_ns = sim_now_ns + HALF_NS / 2;
+    stretch_ns += HALF_NS / 2;
+    if (sim_now_ns - stretch_since > STRETCH_MAX_NS) {
+        stretch_since = 0;
+        sim_usi_external(1, 1);
+        nack = 1;
+        transaction_done();
+    }
+    return 1;
+}
+
+void sim_dock_step(void) {
+    if (sim_now_ns < next_ns) return;
+    uint8_t pins = sim_usi_pins();
+    uint8_t scl = (pins >> SCL) & 1, sda = (pins >> SDA) & 1;
+    uint8_t writing = pos <= tx_len;    /* the address counts as written */
+
+    next_ns = sim_now_ns + HALF_NS;
+    switch (phase) {
+        case BUS_START:
+            if (!scl || !sda) return;   /* bus busy */
+            sim_usi_external(1, 0);
+            phase = BUS_SCL_LOW;
+            break;
+        case BUS_SCL_LOW:
+            sim_usi_external(0, 0);
+            pos = 0;
+            bit = 0;
+            phase = BUS_LOW;
+            break;
+        case BUS_LOW:
+            if (bit < 8) out = writing ? ((pos == 0 ? addr : tx[pos - 1]) >> (7 - bit)) & 1 : 1;
+            else out = writing ? 1 : rx_len + 1 == rx_want;     /* NACK the last byte read */
+            sim_usi_external(0, out);
+            next_ns = sim_now_ns + HALF_NS / 2;
+            phase = BUS_RISE;
+            break;
+        case BUS_RISE:
+            sim_usi_external(1, out);
+            phase = BUS_HIGH;
+            break;
+        case BUS_HIGH:
+            if (stretched(scl)) return;
+            if (bit < 8) shift = (uint8_t)(shift << 1) | sda;
+            else if (writing && sda) nack = 1;
+            sim_usi_external(0, out);
+            next_ns = sim_now_ns + HALF_NS / 2;    /* SDA changes in the middle of SCL low */
+            phase = BUS_LOW;
+            if (++bit < 9) break;
+            bit = 0;
+            if (!writing) rx[rx_len++] = shift;
+            pos++;
+            if (nack || pos == 1 + tx_len + rx_want) phase = BUS_STOP;
+            break;
+        case BUS_STOP:
+            sim_usi_external(0, 0);
+            phase = BUS_STOP_SCL;
+            break;
+        case BUS_STOP_SCL:
+            sim_usi_external(1, 0);
+            phase = BUS_STOP_SDA;
+            break;
+        case BUS_STOP_SDA:
+            if (stretched(scl)) return;
+            sim_usi_external(1, 1);
+            transaction_done();
+            break;
+    }
+}
+
+void sim_dock_report(FILE *f) {
+    if (!docked) return;
+    if (!answered) {
+        fprintf(f, "dock:        no answer (%u polls)\n", polls);
+        return;
+    }
+    fprintf(f, "dock:        answered after %.3fs, id %02X version %u status %02X, %.2fV, interval %u, volume %u\n",
+            (answered_ns - docked_ns) / 1e9, regs[DOCK_REG_ID], regs[DOCK_REG_VERSION], regs[DOCK_REG_STATUS],
+            (regs[DOCK_REG_VCC] | (regs[DOCK_REG_VCC + 1] << 8)) / 100.0, regs[DOCK_REG_INTERVAL],
+            regs[DOCK_REG_VOLUME]);
+    if (job != JOB_DONE) {
+        fprintf(f, "dock:        readout not finished, %u records\n", records);
+        return;
+    }
+    double s = (done_ns - answered_ns) / 1e9;
+    fprintf(f, "dock:        %u records", records);
+    if (expected != records) fprintf(f, " of %u sent", expected);
+    fprintf(f, ", %u CRC errors, %u bytes in %u transactions, %.3fs (%.0f bytes/s, %.1f%% clock stretching)\n",
+            crc_errors, bytes, transactions, s, s > 0 ? bytes / s : 0.0, s > 0 ? stretch_ns / 1e7 / s : 0.0);
+}
@@ -0,0 +1,213 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host tool: decode a recording (WAV) of the data export into CSV
+ *
+ * The firmware sends the data logger as FSK tones (see beep.c, logger.h).
+ * Both tones are correlated over a sliding window of one bit; the sign of
+ * the difference is the bit value, signal below 1/20 of the loudest part
+ * of the recording is silence. Bytes are sampled like a UART from the
+ * falling edge of the start bit, frames are checked by their CRC. The bit
+ * length is measured on the leader (0xFF bytes: one start bit every 10 bits),
+ * which takes care of the RC oscillator of the ATtiny85 being off by a few
+ * percent.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "logger.h"
+
+#define FSK_BAUD    1000
+#define FSK_MARK    5000.0      /* Hz, bit value 1 */
+#define FSK_SPACE   4000.0      /* Hz, bit value 0 */
+
+static int16_t *audio = NULL;
+static uint32_t audio_len = 0, rate = 0;
+
+static uint32_t get_le(const uint8_t *p, uint8_t bytes) {
+    uint32_t v = 0;
+    while (bytes--) v = (v << 8) | p[bytes];
+    return v;
+}
+
+/* 16 bit PCM, the first channel is used */
+static int load_wav(const char *path) {
+    FILE *f = fopen(path, "rb");
+    uint8_t hdr[12], chunk[8], fmt[16];
+    uint16_t channels = 0, bits = 0;
+
+    if (f == NULL) return -1;
+    if (fread(hdr, 1, 12, f) != 12 || memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0) goto FAIL;
+    while (fread(chunk, 1, 8, f) == 8) {
+        uint32_t size = get_le(chunk + 4, 4);
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+            if (fread(fmt, 1, 16, f) != 16) goto FAIL;
+            if (get_le(fmt, 2) != 1) goto FAIL;     /* PCM */
+            channels = get_le(fmt + 2, 2);
+            rate = get_le(fmt + 4, 4);
+            bits = get_le(fmt + 14, 2);
+            fseek(f, size - 16 + (size & 1), SEEK_CUR);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (channels == 0 || bits != 16 || rate < 4 * FSK_MARK) goto FAIL;
+            audio_len = size / 2 / channels;
+            audio = malloc(audio_len * sizeof(int16_t));
+            for (uint32_t i = 0; i < audio_len; i++) {
+                uint8_t s[2];
+                if (fread(s, 1, 2, f) != 2) {
+                    audio_len = i;
+                    break;
+                }
+                audio[i] = (int16_t)get_le(s, 2);
+                fseek(f, 2 * (channels - 1), SEEK_CUR);
+            }
+            fclose(f);
+            return 0;
+        } else {
+            fseek(f, size + (size & 1), SEEK_CUR);
+        }
+    }
+FAIL:
+    fclose(f);
+    return -1;
+}
+
+/* energy of both tones over the bit ending at each sample: >0 for 1, <0 for 0, 0 for silence */
+static float *demodulate(void) {
+    uint32_t n = rate / FSK_BAUD;
+    double w[2] = {2 * M_PI * FSK_MARK / rate, 2 * M_PI * FSK_SPACE / rate};
+    double sum[2][2] = {{0, 0}, {0, 0}}, peak = 0;
+    float *d = calloc(audio_len, sizeof(float)), *e = calloc(audio_len, sizeof(float));
+
+    for (uint32_t i = 0; i < audio_len; i++) {
+        double energy[2];
+        for (uint8_t t = 0; t < 2; t++) {
+            /* running sums of the sample mixed with the tone (cos and sin) */
+            sum[t][0] += audio[i] * cos(w[t] * i);
+            sum[t][1] += audio[i] * sin(w[t] * i);
+            if (i >= n) {
+                sum[t][0] -= audio[i - n] * cos(w[t] * (i - n));
+                sum[t][1] -= audio[i - n] * sin(w[t] * (i - n));
+            }
+            energy[t] = sum[t][0] * sum[t][0] + sum[t][1] * sum[t][1];
+        }
+        d[i] = energy[0] - energy[1];
+        e[i] = energy[0] + energy[1];
+        if (e[i] > peak) peak = e[i];
+    }
+    for (uint32_t i = 0; i < audio_len; i++) {
+        if (e[i] < peak / 20) d[i] = 0;
+    }
+    free(e);
+    return d;
+}
+
+static int compare(const void *a, const void *b) {
+    return *(const uint32_t *)a - *(const uint32_t *)b;
+}
+
+/* median distance of start bits 10 bits apart, or the nominal bit length */
+static double bit_length(const float *d) {
+    double nominal = (double)rate / FSK_BAUD;
+    uint32_t *dist = malloc(audio_len / 8 * sizeof(uint32_t)), n = 0, last = 0;
+    double bit = nominal;
+
+    for (uint32_t i = 1; i < audio_len; i++) {
+        if (!(d[i - 1] > 0 && d[i] <= 0)) continue;
+        if (last > 0 && i - last > 8.5 * nominal && i - last < 11.5 * nominal) dist[n++] = i - last;
+        last = i;
+    }
+    if (n > 0) {
+        qsort(dist, n, sizeof(uint32_t), compare);
+        bit = dist[n / 2] / 10.0;
+    }
+    free(dist);
+    return bit;
+}
+
+static uint8_t crc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0xFF;
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : crc << 1;
+    }
+    return crc;
+}
+
+static uint8_t frame[LOGGER_EXPORT_FRAME];
+static uint8_t frame_len = 0;
+static unsigned records = 0, skipped = 0, ended = 0, expected = 0;
+
+static void frame_byte(uint8_t b) {
+    frame[frame_len++] = b;
+    while (frame_len > 0) {
+        if (frame[0] != LOGGER_EXPORT_RECORD && frame[0] != LOGGER_EXPORT_END) {
+            /* not the start of a frame (leader or lost sync) */
+            if (frame[0] != 0xFF) skipped++;
+        } else if (frame_len < LOGGER_EXPORT_FRAME) {
+            return;
+        } else if (crc8(frame, LOGGER_EXPORT_FRAME - 1) == frame[LOGGER_EXPORT_FRAME - 1]) {
+            if (frame[0] == LOGGER_EXPORT_RECORD) {
+                printf("%u,%u,%.1f,%u,%u,%u\n", records++, frame[1] | (frame[2] << 8),
+                       (int16_t)(frame[3] | (frame[4] << 8)) / 10.0, frame[5],
+                       (frame[6] & LOGGER_FLAG_SESSION) ? 1 : 0, (frame[6] & LOGGER_FLAG_GAP) ? 1 : 0);
+            } else {
+                ended = 1;
+                expected = frame[1] | (frame[2] << 8);
+            }
+            frame_len = 0;
+            return;
+        } else {
+            skipped++;
+        }
+        /* resynchronize on the next byte */
+        memmove(frame, frame + 1, --frame_len);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s FILE.wav > log.csv\n", argv[0]);
+        return 1;
+    }
+    if (load_wav(argv[1]) != 0) {
+        fprintf(stderr, "cannot read '%s' (16 bit PCM WAV, at least 20kHz sample rate)\n", argv[1]);
+        return 1;
+    }
+    float *d = demodulate();
+    double bit = bit_length(d);
+    unsigned bytes = 0, errors = 0;
+
+    printf("record,co2_ppm,temp_c,humidity_rh,power_on,gap\n");
+    for (uint32_t i = 1; i < audio_len; i++) {
+        /* falling edge of a start bit: the window is half-way into it */
+        if (!(d[i - 1] > 0 && d[i] <= 0)) continue;
+        double start = i + bit / 2 - 1;    /* window covers the start bit */
+        uint16_t v = 0;
+        uint8_t ok = 1;
+        for (uint8_t b = 0; b < 10 && ok; b++) {
+            uint32_t at = (uint32_t)(start + b * bit + 0.5);
+            if (at >= audio_len || d[at] == 0) ok = 0;
+            else if (d[at] > 0) v |= 1 << b;
+        }
+        if (!ok || (v & 0x001) || !(v & 0x200)) {
+            /* no start or stop bit: a glitch or lost sync */
+            errors++;
+            continue;
+        }
+        frame_byte(v >> 1);
+        bytes++;
+        i = (uint32_t)(start + 9 * bit);    /* middle of the stop bit */
+    }
+
+    fprintf(stderr, "%.0f baud: %u bytes, %u framing errors, %u bytes skipped, %u records", rate / bit, bytes, errors, skipped, records);
+    if (ended) fprintf(stderr, " of %u sent", expected);
+    fprintf(stderr, "\n");
+    free(d);
+    free(audio);
+    return ended && records == expected ? 0 : 2;
+}
@@ -0,0 +1,249 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: I2C devices and stand-in for i2cmaster.S
+ * Same API, but bytes are routed to the virtual SSD1306 and SCD4x. The bus
+ * time is charged with the cycle count of the bit-banged implementation.
+ * With I2C_USI, usimaster.c is used instead and the bus model (usi.c)
+ * routes the bytes it decodes through the same device side.
+ */
+
+#include "i2cmaster.h"
+#include "sim.h"
+
+/* i2c_delay_T2 incl. rcall, see i2cmaster.S (the bus runs at F_CPU_FAST) */
+#if F_CPU_FAST <= 1000000UL
+#define DELAY_STANDARD 0    /* bare ret */
+#define DELAY_FAST     0
+#elif F_CPU_FAST <= 4000000UL
+#define DELAY_STANDARD 4
+#define DELAY_FAST     1
+#elif F_CPU_FAST <= 8000000UL
+#define DELAY_STANDARD 11
+#define DELAY_FAST     1
+#elif F_CPU_FAST <= 12000000UL
+#define DELAY_STANDARD 18
+#define DELAY_FAST     3
+#elif F_CPU_FAST <= 16000000UL
+#define DELAY_STANDARD 24
+#define DELAY_FAST     4
+#else
+#define DELAY_STANDARD 31
+#define DELAY_FAST     6
+#endif
+#define T2 (i2c_delay > 0 ? 8 + 3 * i2c_delay : 7)
+
+#define CYCLES_START (7 + T2)
+#define CYCLES_STOP  (15 + 3 * T2)
+#define CYCLES_WRITE (127 + 18 * T2)
+#define CYCLES_READ  (135 + 18 * T2)
+
+#define DEV_NONE    0xFF
+#define DEV_SSD1306 0
+#define DEV_SCD4x   1
+#define DEV_COUNT   2
+
+static const struct {
+    const char *name;
+    uint8_t addr;   /* 8 bit address (write) */
+} devices[DEV_COUNT] = {
+    {"SSD1306", 0x78},
+    {"SCD4x", 0xC4},
+};
+
+static struct {
+    uint32_t transactions;
+    uint32_t nacks;
+    uint64_t bytes_written;
+    uint64_t bytes_read;
+    uint64_t bus_ns;
+} stats[DEV_COUNT];
+
+static uint64_t cut_ns[DEV_COUNT] = {UINT64_MAX, UINT64_MAX};   /* cable broken: no more ACKs */
+static uint64_t fix_ns[DEV_COUNT] = {UINT64_MAX, UINT64_MAX};   /* ... until it's repaired */
+
+static uint8_t dev = DEV_NONE;
+static uint64_t dev_since;      /* start condition of the current transaction */
+static uint8_t dev_read;
+static char logline[256];
+static uint8_t loglen;
+
+static void log_flush(void) {
+    if (sim_log != NULL && loglen > 0) {
+        fprintf(sim_log, "%10.3f %-7s %c%s\n", sim_now_ns / 1e9, devices[dev].name, dev_read ? 'R' : 'W', logline);
+    }
+    loglen = 0;
+    logline[0] = '\0';
+}
+
+static void log_byte(uint8_t b) {
+    if (sim_log != NULL && loglen < sizeof(logline) - 4) {
+        loglen += snprintf(logline + loglen, sizeof(logline) - loglen, " %02x", b);
+    }
+}
+
+void sim_i2c_reset(void) {
+    dev = DEV_NONE;
+}
+
+void sim_i2c_cut(uint64_t at_ns, uint64_t len_ns, uint8_t sensor) {
+    cut_ns[sensor ? DEV_SCD4x : DEV_SSD1306] = at_ns;
+    fix_ns[sensor ? DEV_SCD4x : DEV_SSD1306] = len_ns ? at_ns + len_ns : UINT64_MAX;
+}
+
+void sim_i2c_report(FILE *f) {
+    for (uint8_t i = 0; i < DEV_COUNT; i++) {
+        fprintf(f, "i2c %-8s %u transactions (%u NACK), %llu bytes written, %llu read, %.3fs bus time\n",
+                devices[i].name, stats[i].transactions, stats[i].nacks,
+                (unsigned long long)stats[i].bytes_written, (unsigned long long)stats[i].bytes_read,
+                stats[i].bus_ns / 1e9);
+        if (cut_ns[i] == UINT64_MAX) continue;
+        fprintf(f, "i2c %-8s cable broken at %.3fs", devices[i].name, cut_ns[i] / 1e9);
+        if (fix_ns[i] != UINT64_MAX) fprintf(f, ", repaired at %.3fs", fix_ns[i] / 1e9);
+        fprintf(f, "\n");
+    }
+}
+
+uint64_t sim_i2c_bytes(void) {
+    uint64_t n = 0;
+    for (uint8_t i = 0; i < DEV_COUNT; i++) n += stats[i].transactions + stats[i].bytes_written + stats[i].bytes_read;
+    return n;
+}
+
+uint64_t sim_i2c_bus_ns(void) {
+    uint64_t ns = 0;
+    for (uint8_t i = 0; i < DEV_COUNT; i++) ns += stats[i].bus_ns;
+    return ns;
+}
+
+/* device side of the bus: the bus time of a transaction is counted from its
+ * (repeated) start to the next start or stop condition */
+static void transaction_end(void) {
+    if (dev == DEV_NONE) return;
+    stats[dev].bus_ns += sim_now_ns - dev_since;
+    log_flush();
+    dev = DEV_NONE;
+}
+
+void sim_i2c_bus_start(void) {
+    transaction_end();
+    dev_since = sim_now_ns;
+}
+
+uint8_t sim_i2c_bus_address(uint8_t addr) {
+    uint8_t ack = 0;
+    for (uint8_t i = 0; i < DEV_COUNT; i++) {
+        if ((addr & 0xFE) == devices[i].addr) dev = i;
+    }
+    if (dev == DEV_NONE || !sim_devices_powered()) {
+        dev = DEV_NONE;
+        return 0;
+    }
+    stats[dev].transactions++;
+    dev_read = addr & I2C_READ;
+    if (sim_now_ns >= cut_ns[dev] && sim_now_ns < fix_ns[dev]) ack = 0;
+    else if (dev == DEV_SSD1306) ack = dev_read ? 0 : sim_ssd1306_start();
+    else if (dev == DEV_SCD4x) ack = sim_scd4x_start(dev_read);
+    if (!ack) {
+        stats[dev].nacks++;
+        dev = DEV_NONE;
+    }
+    return ack;
+}
+
+uint8_t sim_i2c_bus_write(uint8_t data) {
+    uint8_t ack = 0;
+    if (dev == DEV_NONE || dev_read) return 0;
+    stats[dev].bytes_written++;
+    log_byte(data);
+    if (dev == DEV_SSD1306) ack = sim_ssd1306_write(data);
+    else if (dev == DEV_SCD4x) ack = sim_scd4x_write(data);
+    return ack;
+}
+
+uint8_t sim_i2c_bus_read(void) {
+    uint8_t data = 0xFF;    /* released bus reads as 0xFF */
+    if (dev == DEV_SCD4x && dev_read) data = sim_scd4x_read();
+    if (dev != DEV_NONE) {
+        stats[dev].bytes_read++;
+        log_byte(data);
+    }
+    return data;
+}
+
+void sim_i2c_bus_stop(void) {
+    if (dev == DEV_SSD1306) sim_ssd1306_stop();
+    else if (dev == DEV_SCD4x) sim_scd4x_stop();
+    transaction_end();
+}
+
+#ifndef I2C_USI
+/* stand-in for i2cmaster.S (devices never stretch the clock here) */
+static uint8_t i2c_delay = DELAY_FAST;
+unsigned char i2c_timeout;
+
+void i2c_init(void) {
+    sim_i2c_reset();
+}
+
+void i2c_speed(unsigned char fast) {
+    sim_cycles(7);
+    i2c_delay = fast ? DELAY_FAST : DELAY_STANDARD;
+}
+
+void i2c_stop(void) {
+    sim_cycles(CYCLES_STOP);
+    sim_i2c_bus_stop();
+}
+
+unsigned char i2c_start(unsigned char addr) {
+    i2c_timeout = 0;
+    sim_i2c_bus_start();
+    sim_cycles(CYCLES_START + CYCLES_WRITE);
+    return sim_i2c_bus_address(addr) ? 0 : 1;
+}
+
+unsigned char i2c_rep_start(unsigned char addr) {
+    sim_cycles(4 * T2 + 8);
+    if (i2c_timeout) return 1;
+    return i2c_start(addr);
+}
+
+unsigned char i2c_start_wait(unsigned char addr) {
+    uint16_t tries = I2C_START_TRIES;
+    while (i2c_start(addr) != 0) {
+        i2c_stop();
+        if (--tries == 0) return i2c_timeout = 1;
+    }
+    return 0;
+}
+
+unsigned char i2c_write(unsigned char data) {
+    if (i2c_timeout) {
+        sim_cycles(7);
+        return 1;
+    }
+    sim_cycles(CYCLES_WRITE);
+    return sim_i2c_bus_write(data) ? 0 : 1;
+}
+
+unsigned char i2c_readAck(void) {
+    if (i2c_timeout) {
+        sim_cycles(7);
+        return 0xFF;
+    }
+    sim_cycles(CYCLES_READ);
+    return sim_i2c_bus_read();
+}
+
+unsigned char i2c_readNak(void) {
+    if (i2c_timeout) {
+        sim_cycles(7);
+        return 0xFF;
+    }
+    sim_cycles(CYCLES_READ);
+    return sim_i2c_bus_read();
+}
+#endif /* !I2C_USI */
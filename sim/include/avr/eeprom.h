@@ -0,0 +1,27 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/eeprom.h> (EEMEM is plain memory)
+ */
+
+#ifndef _SIM_AVR_EEPROM_H
+#define _SIM_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "io.h"
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+uint16_t eeprom_read_word(const uint16_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_write_byte(uint8_t *p, uint8_t value);
+void eeprom_update_byte(uint8_t *p, uint8_t value);
+void eeprom_update_word(uint16_t *p, uint16_t value);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+void eeprom_busy_wait(void);
+
+#endif /* !_SIM_AVR_EEPROM_H */
@@ -0,0 +1,30 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/interrupt.h>
+ */
+
+#ifndef _SIM_AVR_INTERRUPT_H
+#define _SIM_AVR_INTERRUPT_H
+
+#include "io.h"
+
+/* interrupt vectors are plain functions; the virtual core calls them */
+#define ISR(vector) void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) {}
+
+void TIM0_COMPA_vect(void);
+void TIM0_COMPB_vect(void);
+void PCINT0_vect(void);
+void WDT_vect(void);
+void TIM1_COMPA_vect(void);
+void TIM1_OVF_vect(void);
+void USI_START_vect(void);
+void USI_OVF_vect(void);
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+
+#endif /* !_SIM_AVR_INTERRUPT_H */
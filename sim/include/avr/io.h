@@ -0,0 +1,205 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/io.h> (ATtiny85 registers)
+ * Every register access goes through sim_io(), which lets the virtual
+ * peripherals update their state and advances the simulated clock.
+ */
+
+#ifndef _SIM_AVR_IO_H
+#define _SIM_AVR_IO_H
+
+#include <stdint.h>
+#include "../../sim.h"
+
+#define _BV(bit) (1 << (bit))
+
+#define ADCSRB (*sim_io(SIM_IO_ADCSRB))
+#define ADCL   (*sim_io(SIM_IO_ADCL))
+#define ADCH   (*sim_io(SIM_IO_ADCH))
+#define ADCSRA (*sim_io(SIM_IO_ADCSRA))
+#define ADMUX  (*sim_io(SIM_IO_ADMUX))
+#define USICR  (*sim_io(SIM_IO_USICR))
+#define USISR  (*sim_io(SIM_IO_USISR))
+#define USIDR  (*sim_io(SIM_IO_USIDR))
+#define USIBR  (*sim_io(SIM_IO_USIBR))
+#define PCMSK  (*sim_io(SIM_IO_PCMSK))
+#define PINB   (*sim_io(SIM_IO_PINB))
+#define DDRB   (*sim_io(SIM_IO_DDRB))
+#define PORTB  (*sim_io(SIM_IO_PORTB))
+#define EECR   (*sim_io(SIM_IO_EECR))
+#define EEDR   (*sim_io(SIM_IO_EEDR))
+#define EEARL  (*sim_io(SIM_IO_EEARL))
+#define PRR    (*sim_io(SIM_IO_PRR))
+#define WDTCR  (*sim_io(SIM_IO_WDTCR))
+#define CLKPR  (*sim_io(SIM_IO_CLKPR))
+#define OCR0B  (*sim_io(SIM_IO_OCR0B))
+#define OCR0A  (*sim_io(SIM_IO_OCR0A))
+#define TCCR0A (*sim_io(SIM_IO_TCCR0A))
+#define OCR1B  (*sim_io(SIM_IO_OCR1B))
+#define GTCCR  (*sim_io(SIM_IO_GTCCR))
+#define OCR1C  (*sim_io(SIM_IO_OCR1C))
+#define OCR1A  (*sim_io(SIM_IO_OCR1A))
+#define TCNT1  (*sim_io(SIM_IO_TCNT1))
+#define TCCR1  (*sim_io(SIM_IO_TCCR1))
+#define TCNT0  (*sim_io(SIM_IO_TCNT0))
+#define TCCR0B (*sim_io(SIM_IO_TCCR0B))
+#define MCUSR  (*sim_io(SIM_IO_MCUSR))
+#define MCUCR  (*sim_io(SIM_IO_MCUCR))
+#define TIFR   (*sim_io(SIM_IO_TIFR))
+#define TIMSK  (*sim_io(SIM_IO_TIMSK))
+#define GIMSK  (*sim_io(SIM_IO_GIMSK))
+#define SREG   (*sim_io(SIM_IO_SREG))
+
+/* PORTB / DDRB / PINB */
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define DDB0 0
+#define DDB1 1
+#define DDB2 2
+#define DDB3 3
+#define DDB4 4
+#define DDB5 5
+#define PINB0 0
+#define PINB1 1
+#define PINB2 2
+#define PINB3 3
+#define PINB4 4
+#define PINB5 5
+
+/* ADC */
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE  3
+#define ADIF  4
+#define ADATE 5
+#define ADSC  6
+#define ADEN  7
+#define MUX0  0
+#define MUX1  1
+#define MUX2  2
+#define MUX3  3
+#define REFS2 4
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+/* USI */
+#define USITC  0
+#define USICLK 1
+#define USICS0 2
+#define USICS1 3
+#define USIWM0 4
+#define USIWM1 5
+#define USIOIE 6
+#define USISIE 7
+#define USICNT0 0
+#define USICNT1 1
+#define USICNT2 2
+#define USICNT3 3
+#define USIDC  4
+#define USIPF  5
+#define USIOIF 6
+#define USISIF 7
+
+/* EEPROM */
+#define EERE  0
+#define EEPE  1
+#define EEMPE 2
+#define EERIE 3
+#define EEPM0 4
+#define EEPM1 5
+
+/* PRR */
+#define PRADC  0
+#define PRUSI  1
+#define PRTIM0 2
+#define PRTIM1 3
+
+/* WDTCR */
+#define WDP0 0
+#define WDP1 1
+#define WDP2 2
+#define WDE  3
+#define WDCE 4
+#define WDP3 5
+#define WDIE 6
+#define WDIF 7
+
+/* CLKPR */
+#define CLKPS0 0
+#define CLKPS1 1
+#define CLKPS2 2
+#define CLKPS3 3
+#define CLKPCE 7
+
+/* Timer/Counter0 */
+#define WGM00  0
+#define WGM01  1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define WGM02  3
+
+/* Timer/Counter1 */
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define CS13   3
+#define COM1A0 4
+#define COM1A1 5
+#define PWM1A  6
+#define CTC1   7
+#define PSR0   0
+#define PSR1   1
+#define FOC1A  2
+#define FOC1B  3
+#define COM1B0 4
+#define COM1B1 5
+#define PWM1B  6
+#define TSM    7
+
+/* TIMSK / TIFR */
+#define TOIE0  1
+#define OCIE0B 3
+#define OCIE0A 4
+#define TOIE1  2
+#define OCIE1B 5
+#define OCIE1A 6
+#define TOV0   1
+#define OCF0B  3
+#define OCF0A  4
+#define TOV1   2
+#define OCF1B  5
+#define OCF1A  6
+
+/* MCUCR / MCUSR */
+#define ISC00 0
+#define ISC01 1
+#define SM0   3
+#define SM1   4
+#define SE    5
+#define PUD   6
+#define BODSE 2
+#define BODS  7
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+/* GIMSK */
+#define PCIE 5
+#define INT0 6
+
+#endif /* !_SIM_AVR_IO_H */
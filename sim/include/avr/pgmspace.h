@@ -0,0 +1,25 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/pgmspace.h> (flash is plain memory,
+ * reads cost the cycles of lpm)
+ */
+
+#ifndef _SIM_AVR_PGMSPACE_H
+#define _SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include "io.h"
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (sim_flash_read(SIM_CYCLES_LPM), *(const uint8_t *)(addr))
+#define pgm_read_word(addr) (sim_flash_read(2 * SIM_CYCLES_LPM), *(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (sim_flash_read(4 * SIM_CYCLES_LPM), *(const uint32_t *)(addr))
+#define memcpy_P(dst, src, n) (sim_flash_read(SIM_CYCLES_LPM + (n) * SIM_CYCLES_LPM_BLOCK), memcpy(dst, src, n))
+#define strlen_P strlen
+
+#endif /* !_SIM_AVR_PGMSPACE_H */
@@ -0,0 +1,35 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/power.h>
+ */
+
+#ifndef _SIM_AVR_POWER_H
+#define _SIM_AVR_POWER_H
+
+#include "io.h"
+
+#define power_all_disable() (PRR |= (1 << PRADC) | (1 << PRUSI) | (1 << PRTIM0) | (1 << PRTIM1))
+#define power_all_enable()  (PRR &= ~((1 << PRADC) | (1 << PRUSI) | (1 << PRTIM0) | (1 << PRTIM1)))
+#define power_adc_disable() (PRR |= (1 << PRADC))
+#define power_adc_enable()  (PRR &= ~(1 << PRADC))
+#define power_usi_enable()  (PRR &= ~(1 << PRUSI))
+
+typedef enum {
+    clock_div_1 = 0,
+    clock_div_2 = 1,
+    clock_div_4 = 2,
+    clock_div_8 = 3,
+    clock_div_16 = 4,
+    clock_div_32 = 5,
+    clock_div_64 = 6,
+    clock_div_128 = 7,
+    clock_div_256 = 8
+} clock_div_t;
+
+#define clock_prescale_set(x) do { CLKPR = (1 << CLKPCE); CLKPR = (x); } while (0)
+#define clock_prescale_get() ((clock_div_t)(CLKPR & 0x0F))
+
+#endif /* !_SIM_AVR_POWER_H */
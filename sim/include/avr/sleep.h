@@ -0,0 +1,25 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/sleep.h>
+ */
+
+#ifndef _SIM_AVR_SLEEP_H
+#define _SIM_AVR_SLEEP_H
+
+#include "io.h"
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_ADC      (1 << SM0)
+#define SLEEP_MODE_PWR_DOWN (1 << SM1)
+
+#define set_sleep_mode(mode) sim_set_sleep_mode(mode)
+#define sleep_enable()  (MCUCR |= (1 << SE))
+#define sleep_disable() (MCUCR &= ~(1 << SE))
+#define sleep_cpu()     sim_sleep()
+#define sleep_mode()    do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+#define sleep_bod_disable()
+
+#endif /* !_SIM_AVR_SLEEP_H */
@@ -0,0 +1,16 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <avr/wdt.h> (the firmware configures WDTCR itself)
+ */
+
+#ifndef _SIM_AVR_WDT_H
+#define _SIM_AVR_WDT_H
+
+#include "io.h"
+
+#define wdt_reset() sim_wdr()
+
+#endif /* !_SIM_AVR_WDT_H */
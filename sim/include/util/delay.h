@@ -0,0 +1,19 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <util/delay.h> (busy-waits advance the virtual clock)
+ */
+
+#ifndef _SIM_UTIL_DELAY_H
+#define _SIM_UTIL_DELAY_H
+
+#include "../../sim.h"
+
+/* like avr-libc, the delay is computed from F_CPU at compile time - so it
+ * is only correct while the CPU actually runs at F_CPU */
+#define _delay_ms(ms) sim_delay_cycles((uint64_t)((double)(ms) * (F_CPU / 1000.0)))
+#define _delay_us(us) sim_delay_cycles((uint64_t)((double)(us) * (F_CPU / 1000000.0)))
+
+#endif /* !_SIM_UTIL_DELAY_H */
@@ -0,0 +1,20 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: stand-in for <util/delay_basic.h> (counted loops)
+ */
+
+#ifndef _SIM_UTIL_DELAY_BASIC_H
+#define _SIM_UTIL_DELAY_BASIC_H
+
+#include <stdint.h>
+#include "../../sim.h"
+
+/* 3 cycles per iteration, 0 means 256 */
+static inline void _delay_loop_1(uint8_t count) {
+    sim_delay_cycles(3 * (count ? count : 256));
+}
+
+#endif /* !_SIM_UTIL_DELAY_BASIC_H */
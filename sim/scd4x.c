@@ -0,0 +1,360 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: virtual SCD40/SCD41 sensor replaying a CO₂ profile
+ * Datasheet: https://sensirion.com/media/documents/48C4B7FB/64C134E7/Sensirion_SCD4x_Datasheet.pdf
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+#define MS 1000000ULL
+#define MAX_POINTS 1024
+
+/* supply current at 3.3V (datasheet, "Electrical Specifications"), in mA */
+#define MA_PERIODIC     15.0
+#define MA_LOW_POWER    3.2     /* low power periodic measurement (average) */
+#define MA_SINGLE_SHOT  18.0    /* while a single shot is executed */
+#define MA_IDLE         0.2
+#define MA_SLEEP        0.0005
+
+typedef enum {
+    STATE_IDLE,
+    STATE_PERIODIC,
+    STATE_SLEEP
+} scd4x_state_t;
+
+typedef struct {
+    double t;       /* seconds */
+    double co2;     /* ppm */
+    double temp;    /* °C */
+    double rh;      /* % */
+} point_t;
+
+/* default profile: a day trip into a CO₂ cave (approach, descent, sump, return) */
+static point_t default_profile[] = {
+    {    0,   430, 18.0, 55},
+    { 1200,   450, 15.0, 70},
+    { 2400,  2500, 10.0, 92},
+    { 4800,  9000,  9.5, 97},
+    { 7200, 16000,  9.0, 99},
+    { 9600, 23000,  9.0, 99},
+    {12000, 26500,  9.0, 99},
+    {14400, 21000,  9.0, 99},
+    {18000, 12000,  9.5, 97},
+    {21600,  4000, 10.0, 93},
+    {25200,   900, 14.0, 75},
+    {28800,   440, 16.0, 60},
+};
+
+static point_t *profile = default_profile;
+static uint16_t profile_len = sizeof(default_profile) / sizeof(default_profile[0]);
+
+static scd4x_state_t state = STATE_IDLE;
+static uint64_t busy_until = 0;
+static uint64_t next_sample = 0;
+static uint64_t sample_period = 5000 * MS;
+static uint8_t data_ready = 0;
+static uint16_t value[3];               /* raw co2, temp, rh of the last measurement */
+static uint16_t altitude = 0, altitude_persisted = 0;
+static uint16_t asc = 1, asc_persisted = 1;
+static uint32_t noise = 1;
+static uint8_t noisy = 1;               /* 0: -n, the exact profile values */
+
+/* transaction state */
+static uint8_t rx[32], rx_len;
+static uint8_t tx[32], tx_len, tx_pos;
+static uint32_t illegal_commands = 0;
+static uint32_t measurements = 0;
+static uint32_t single_shots = 0;
+
+static uint16_t feature_set = 0x1440;   /* SCD41 */
+static uint64_t shot_until = 0;         /* end of a running single shot measurement */
+static uint8_t shot_rht_only;
+static uint8_t powered = 0;
+
+/* injected fault (-H/-F): the sensor hangs until the given recovery */
+static uint64_t hang_at = UINT64_MAX;
+static uint8_t hang_frozen;             /* 0: no new data, 1: the same values again and again */
+static uint8_t hang_cure;               /* 1: stop periodic measurement, 2: reinit, 3: power cycle */
+static uint8_t hanging = 0;
+static uint64_t hang_start_ns, hang_end_ns;
+static uint64_t charge_since = 0;       /* supply charge is accounted up to this time */
+static double charge = 0;               /* mA * ns */
+
+static uint8_t crc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0xFF;
+    for (uint8_t x = 0; x < len; x++) {
+        crc ^= data[x];
+        for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void respond(const uint16_t *words, uint8_t n) {
+    tx_len = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        tx[tx_len++] = words[i] >> 8;
+        tx[tx_len++] = words[i] & 0xFF;
+        tx[tx_len] = crc8(tx + tx_len - 2, 2);
+        tx_len++;
+    }
+    tx_pos = 0;
+}
+
+static point_t interpolate(double t) {
+    if (t <= profile[0].t) return profile[0];
+    for (uint16_t i = 1; i < profile_len; i++) {
+        if (t < profile[i].t) {
+            const point_t *a = &profile[i - 1], *b = &profile[i];
+            double f = (t - a->t) / (b->t - a->t);
+            point_t p = {t, a->co2 + (b->co2 - a->co2) * f, a->temp + (b->temp - a->temp) * f, a->rh + (b->rh - a->rh) * f};
+            return p;
+        }
+    }
+    return profile[profile_len - 1];
+}
+
+static double jitter(double amplitude) {
+    if (!noisy) return 0;
+    noise = noise * 1103515245UL + 12345UL;
+    return amplitude * (((noise >> 16) & 0x7FFF) / 16383.5 - 1.0);
+}
+
+static void cure(uint8_t recovery) {
+    if (!hanging || recovery < hang_cure) return;
+    hanging = 0;
+    hang_end_ns = sim_now_ns;
+}
+
+static void measure(uint64_t at) {
+    if (at >= hang_at) {
+        hanging = 1;
+        hang_start_ns = at;
+        hang_at = UINT64_MAX;
+    }
+    if (hanging) {
+        if (hang_frozen) data_ready = 1;
+        return;
+    }
+    point_t p = interpolate(at / 1e9);
+    double co2 = p.co2 + jitter(10.0);
+    double temp = p.temp + jitter(0.05);
+    double rh = p.rh + jitter(0.2);
+    if (co2 < 0) co2 = 0;
+    if (co2 > 40000) co2 = 40000;
+    if (rh > 100) rh = 100;
+    value[0] = (uint16_t)co2;
+    value[1] = (uint16_t)((temp + 45.0) * 65536.0 / 175.0);
+    value[2] = (uint16_t)(rh * 65536.0 / 100.0);
+    data_ready = 1;
+    measurements++;
+}
+
+/* account the supply charge up to now (call before changing state) */
+static void account(void) {
+    double ma = 0;
+    if (powered) {
+        switch (state) {
+            case STATE_PERIODIC: ma = sample_period > 5000 * MS ? MA_LOW_POWER : MA_PERIODIC; break;
+            case STATE_SLEEP: ma = MA_SLEEP; break;
+            default: ma = sim_now_ns < shot_until ? MA_SINGLE_SHOT : MA_IDLE; break;
+        }
+    }
+    if (state == STATE_IDLE && shot_until > charge_since && shot_until < sim_now_ns) {
+        /* single shot has ended in between */
+        charge += (shot_until - charge_since) * MA_SINGLE_SHOT + (sim_now_ns - shot_until) * MA_IDLE;
+    } else {
+        charge += (sim_now_ns - charge_since) * ma;
+    }
+    charge_since = sim_now_ns;
+}
+
+/* catch up with the measurement cycle of the periodic mode, finish single shots */
+static void update(void) {
+    if (shot_until > 0 && sim_now_ns >= shot_until) {
+        measure(shot_until);
+        if (shot_rht_only) value[0] = 0;    /* datasheet: CO2 output is 0 ppm */
+        single_shots++;
+        account();
+        shot_until = 0;
+    }
+    if (state != STATE_PERIODIC) return;
+    while (sim_now_ns >= next_sample) {
+        measure(next_sample);
+        next_sample += sample_period;
+    }
+}
+
+static void execute(void) {
+    uint16_t cmd = (rx[0] << 8) | rx[1];
+    uint16_t arg = rx_len >= 5 ? (rx[2] << 8) | rx[3] : 0;
+    uint64_t exec = 1 * MS;
+    uint16_t w;
+
+    tx_len = 0;
+    account();
+    if (state == STATE_SLEEP && cmd != 0x36f6) return;
+    if (state == STATE_PERIODIC && cmd != 0xec05 && cmd != 0xe4b8 && cmd != 0x3f86) {
+        illegal_commands++;
+        if (sim_log != NULL) fprintf(sim_log, "SCD4x: command 0x%04x not allowed during periodic measurement\n", cmd);
+        return;
+    }
+    switch (cmd) {
+        case 0x21b1:    /* start_periodic_measurement */
+        case 0x21ac:    /* start_low_power_periodic_measurement */
+            state = STATE_PERIODIC;
+            sample_period = (cmd == 0x21ac ? 30000 : 5000) * MS;
+            next_sample = sim_now_ns + sample_period;
+            exec = 0;
+            break;
+        case 0x3f86:    /* stop_periodic_measurement */
+            cure(1);
+            state = STATE_IDLE;
+            exec = 500 * MS;
+            break;
+        case 0xec05:    /* read_measurement */
+            if (!data_ready) break;    /* datasheet: read without new data gives a NACK */
+            respond(value, 3);
+            data_ready = 0;
+            break;
+        case 0xe4b8:    /* get_data_ready_status */
+            w = data_ready ? 0x8006 : 0x8000;
+            respond(&w, 1);
+            break;
+        case 0x219d:    /* measure_single_shot (SCD41 only) */
+        case 0x2196:    /* measure_single_shot_rht_only (SCD41 only) */
+            if (!(feature_set & 0x1000)) {
+                illegal_commands++;
+                if (sim_log != NULL) fprintf(sim_log, "SCD4x: command 0x%04x not supported by SCD40\n", cmd);
+                return;
+            }
+            exec = cmd == 0x219d ? 5000 * MS : 50 * MS;
+            shot_until = sim_now_ns + exec;
+            shot_rht_only = cmd == 0x2196;
+            break;
+        case 0x202f:    /* get_feature_set_version */
+            w = feature_set;
+            respond(&w, 1);
+            break;
+        case 0x3682: {  /* get_serial_number */
+            uint16_t serial[3] = {0x5c4d, 0x7f07, 0x3bbf};
+            respond(serial, 3);
+            break;
+        }
+        case 0x2322: respond(&altitude, 1); break;
+        case 0x2427: altitude = arg; break;
+        case 0x2313: respond(&asc, 1); break;
+        case 0x2416: asc = arg; break;
+        case 0x362f:    /* perform_forced_recalibration */
+            measure(sim_now_ns);
+            w = 0x8000 + (int16_t)(arg - value[0]);
+            respond(&w, 1);
+            exec = 400 * MS;
+            break;
+        case 0x3639:    /* perform_self_test */
+            w = 0;
+            respond(&w, 1);
+            exec = 10000 * MS;
+            break;
+        case 0x3615:    /* persist_settings */
+            altitude_persisted = altitude;
+            asc_persisted = asc;
+            exec = 800 * MS;
+            break;
+        case 0x3646:    /* reinit */
+            cure(2);
+            altitude = altitude_persisted;
+            asc = asc_persisted;
+            exec = 30 * MS;
+            break;
+        case 0x36e0: state = STATE_SLEEP; break;
+        case 0x36f6: state = STATE_IDLE; exec = 20 * MS; break;
+        default:
+            illegal_commands++;
+            if (sim_log != NULL) fprintf(sim_log, "SCD4x: unknown command 0x%04x\n", cmd);
+            return;
+    }
+    busy_until = sim_now_ns + exec;
+}
+
+void sim_scd4x_power(uint8_t on) {
+    account();
+    if (!on) cure(3);
+    powered = on;
+    shot_until = 0;
+    state = STATE_IDLE;
+    data_ready = 0;
+    tx_len = rx_len = 0;
+    altitude = altitude_persisted;
+    asc = asc_persisted;
+    busy_until = on ? sim_now_ns + 30 * MS : 0;   /* power-up time */
+}
+
+uint8_t sim_scd4x_start(uint8_t read) {
+    update();
+    if (sim_now_ns < busy_until) return 0;  /* busy: no ACK */
+    if (read) {
+        tx_pos = 0;
+        return tx_len > 0;
+    }
+    rx_len = 0;
+    return 1;
+}
+
+uint8_t sim_scd4x_write(uint8_t data) {
+    if (rx_len < sizeof(rx)) rx[rx_len++] = data;
+    return 1;
+}
+
+uint8_t sim_scd4x_read(void) {
+    return tx_pos < tx_len ? tx[tx_pos++] : 0xFF;
+}
+
+void sim_scd4x_stop(void) {
+    if (rx_len >= 2) execute();
+    rx_len = 0;
+}
+
+void sim_scd4x_set_noise(uint8_t on) {
+    noisy = on;
+}
+
+int sim_scd4x_load_profile(const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    if (f == NULL) return -1;
+    profile = calloc(MAX_POINTS, sizeof(point_t));
+    profile_len = 0;
+    while (fgets(line, sizeof(line), f) != NULL && profile_len < MAX_POINTS) {
+        point_t p = {0, 0, 20.0, 50.0};
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%lf %lf %lf %lf", &p.t, &p.co2, &p.temp, &p.rh) >= 2) profile[profile_len++] = p;
+    }
+    fclose(f);
+    return profile_len > 0 ? 0 : -1;
+}
+
+void sim_scd4x_hang(uint64_t at_ns, uint8_t frozen, uint8_t recovery) {
+    hang_at = at_ns;
+    hang_frozen = frozen;
+    hang_cure = recovery;
+}
+
+void sim_scd4x_set_type(uint8_t scd41) {
+    feature_set = scd41 ? 0x1440 : 0x0440;
+}
+
+void sim_scd4x_report(FILE *f) {
+    account();
+    fprintf(f, "scd4x:       %u measurements (%u single shot), %u rejected commands, %.3f mA average (estimate)\n",
+            measurements, single_shots, illegal_commands, sim_now_ns > 0 ? charge / sim_now_ns : 0.0);
+    if (hang_start_ns > 0) {
+        fprintf(f, "scd4x:       hung at %.1fs", hang_start_ns / 1e9);
+        if (hanging) fprintf(f, ", still hanging\n");
+        else fprintf(f, ", recovered at %.1fs\n", hang_end_ns / 1e9);
+    }
+}
@@ -0,0 +1,823 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: virtual ATtiny85 core and program entry
+ *
+ * The firmware runs unmodified on the host. Simulated time only advances
+ * when the firmware "spends" CPU cycles (register access, cli/sei, I²C
+ * transfers, _delay_ms) or sleeps, so busy loops are replayed as fast as
+ * the host can execute them and sleep is skipped over in one step.
+ */
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include "logger.h"
+#include "sim.h"
+
+#define NS_PER_CYCLE_BASE 125   /* internal RC oscillator: 8 MHz */
+#define EEPROM_WRITE_NS   3400000ULL
+#define WDT_BASE_NS       16000000ULL   /* 2K cycles of the 128kHz watchdog oscillator */
+#define MAX_BUTTON_EVENTS 64
+#define MAX_MARKS         16
+#define MAX_EXPECTS       64
+
+uint64_t sim_now_ns = 0;
+sim_stats_t sim_stats;
+FILE *sim_log = NULL;
+
+int firmware_main(void);
+
+/* default (empty) vectors; the firmware overrides the ones it uses */
+__attribute__((weak)) void TIM0_COMPA_vect(void) {}
+__attribute__((weak)) void TIM0_COMPB_vect(void) {}
+__attribute__((weak)) void PCINT0_vect(void) {}
+__attribute__((weak)) void WDT_vect(void) {}
+__attribute__((weak)) void TIM1_COMPA_vect(void) {}
+__attribute__((weak)) void TIM1_OVF_vect(void) {}
+__attribute__((weak)) void USI_START_vect(void) {}
+__attribute__((weak)) void USI_OVF_vect(void) {}
+
+static volatile uint8_t io[0x40];
+static uint8_t clkps;           /* active clock prescaler (CLKPR is latched lazily) */
+static uint32_t npc;            /* ns per cycle at the active clock */
+static uint64_t quiet = 0;      /* cycles that may elapse without any timer match or event */
+static uint8_t in_isr = 0;
+static uint8_t sleeping = 0;    /* 0: running, else SLEEP_MODE_* + 1 */
+static uint8_t dispatched = 0;  /* an interrupt was serviced */
+static uint8_t sei_wake = 0;    /* sei() serviced an interrupt right before sleep_cpu() */
+static uint64_t t0_acc = 0;     /* timer0 cycles since the counter was 0 */
+static uint64_t t1_acc = 0;     /* timer1 cycles since last overflow */
+static uint16_t t0_pre = 0;     /* timer0/1 prescaler the cycle counts above are based on */
+static uint16_t t1_pre = 0;
+static uint8_t t0_seen = 0;     /* TCNT0 as last read, to detect writes */
+static uint8_t wdt_seen = 0;    /* WDTCR (without WDIF) as last seen, to detect writes */
+static uint8_t tifr_seen = 0;   /* TIFR at the last access, to detect writes (flags are cleared by writing 1) */
+static uint8_t tifr_access = 0;
+static uint64_t wdt_start = 0;  /* start of the current watchdog period */
+static uint64_t wdt_reset_ns = 0;   /* watchdog system reset (not modelled further: ends the simulation) */
+static uint8_t pin_button = 1;  /* current level of PB1 */
+static uint8_t devices_powered = 0;
+static uint64_t eeprom_busy_until = 0;
+
+static double vcc = 3.30;
+static uint64_t end_ns = 8ULL * 3600 * 1000000000ULL;
+static const char *frame_dir = NULL;
+static uint64_t frame_interval_ns = 60ULL * 1000000000ULL;
+static uint64_t next_frame_ns = 0;
+static const char *final_pbm = NULL;
+static uint8_t final_ascii = 0;
+static uint8_t final_log = 0;
+static uint8_t bench = 0;
+
+static struct {
+    uint64_t at_ns;
+    uint64_t len_ns;
+} buttons[MAX_BUTTON_EVENTS];
+static uint8_t button_count = 0;
+
+/* profile marks: cost of the section since the previous mark */
+static struct {
+    uint64_t at_ns;
+    const char *name;           /* NULL: only start a section */
+} marks[MAX_MARKS];
+static uint8_t mark_count = 0, mark_next = 0;
+static sim_stats_t mark_stats;  /* sim_stats at the previous mark */
+static uint64_t mark_ns = 0, mark_i2c = 0, mark_bus_ns = 0;
+
+/* expectations: display text or number of notes at a time, in time order */
+static struct {
+    uint64_t at_ns;
+    char kind;                  /* 'e': text, 'E': double size text, 'A': notes since the previous 'A' */
+    uint8_t col, page;
+    uint32_t notes;
+    const char *text;
+} expects[MAX_EXPECTS];
+static uint8_t expect_count = 0, expect_next = 0, expect_failed = 0;
+static uint32_t expect_notes = 0;   /* sim_buzzer_notes() at the previous 'A' */
+
+static struct timespec wall_start;
+
+static uint32_t ns_per_cycle(void) {
+    return NS_PER_CYCLE_BASE << clkps;
+}
+
+uint32_t sim_cpu_hz(void) {
+    return 1000000000UL / ns_per_cycle();
+}
+
+uint32_t sim_seconds(void) {
+    return sim_now_ns / 1000000000ULL;
+}
+
+uint8_t sim_devices_powered(void) {
+    return devices_powered;
+}
+
+static uint16_t timer0_prescaler(void) {
+    static const uint16_t prescaler[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return prescaler[io[SIM_IO_TCCR0B] & 0x07];
+}
+
+static uint64_t timer0_period(void) {
+    uint16_t p = timer0_prescaler();
+    if (p == 0 || (io[SIM_IO_PRR] & (1 << PRTIM0))) return 0;
+    if (io[SIM_IO_TCCR0A] & (1 << WGM01)) return (uint64_t)p * (io[SIM_IO_OCR0A] + 1);
+    return (uint64_t)p * 256;
+}
+
+/* cycles from counter 0 to a compare match (the flag is set one timer clock
+ * after the counter reached the register); only modelled as the interrupt
+ * source (no flag while the interrupt is disabled) */
+static uint64_t timer0_match(uint8_t ocr, uint8_t ocie, uint64_t period) {
+    if (period == 0 || !(io[SIM_IO_TIMSK] & (1 << ocie))) return 0;
+    uint64_t m = (uint64_t)t0_pre * (io[ocr] + 1);
+    return m <= period ? m : 0;
+}
+
+/* a write to TIFR since the last access clears the flags written as 1 (a
+ * write of exactly the flags that are set can't be told from a read) */
+static void tifr_sync(void) {
+    if (!tifr_access) return;
+    tifr_access = 0;
+    if (io[SIM_IO_TIFR] != tifr_seen) io[SIM_IO_TIFR] = tifr_seen & ~io[SIM_IO_TIFR];
+}
+
+/* timer1 runs from the system clock (no PLL); in PWM and CTC mode it counts up to OCR1C */
+static uint64_t timer1_period(void) {
+    uint8_t cs = io[SIM_IO_TCCR1] & 0x0F;
+    if (cs == 0 || (io[SIM_IO_PRR] & (1 << PRTIM1))) return 0;
+    uint64_t p = 1ULL << (cs - 1);
+    if (io[SIM_IO_TCCR1] & ((1 << CTC1) | (1 << PWM1A)) || (io[SIM_IO_GTCCR] & (1 << PWM1B))) return p * (io[SIM_IO_OCR1C] + 1);
+    return p * 256;
+}
+
+/* watchdog time-out: 16ms << WDP[3:0] */
+static uint64_t wdt_period(void) {
+    uint8_t w = io[SIM_IO_WDTCR];
+    if (!(w & ((1 << WDIE) | (1 << WDE)))) return 0;
+    uint8_t n = (w & 0x07) | ((w & (1 << WDP3)) ? 8 : 0);
+    return WDT_BASE_NS << (n > 9 ? 9 : n);
+}
+
+static uint8_t button_level(uint64_t t) {
+    for (uint8_t i = 0; i < button_count; i++) {
+        if (t >= buttons[i].at_ns && t < buttons[i].at_ns + buttons[i].len_ns) return 0;
+    }
+    return 1;
+}
+
+static uint64_t next_button_edge(uint64_t t) {
+    uint64_t next = UINT64_MAX;
+    for (uint8_t i = 0; i < button_count; i++) {
+        if (buttons[i].at_ns > t && buttons[i].at_ns < next) next = buttons[i].at_ns;
+        uint64_t rel = buttons[i].at_ns + buttons[i].len_ns;
+        if (rel > t && rel < next) next = rel;
+    }
+    return next;
+}
+
+static void finish(void);
+static void print_duration(FILE *f, uint64_t ns);
+
+static void dump_frame(void) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame-%06u.pbm", frame_dir, sim_seconds());
+    sim_ssd1306_dump_pbm(path);
+}
+
+static void profile_mark(void) {
+    const char *name = marks[mark_next++].name;
+    if (name != NULL) {
+        printf("profile:     %-8s %7.3fs %9llu cycles (%llu in ISRs, %llu reading EEPROM, %llu flash), "
+               "%llu I2C bytes, %.3fs bus time\n", name, (sim_now_ns - mark_ns) / 1e9,
+               (unsigned long long)(sim_stats.cycles_active - mark_stats.cycles_active),
+               (unsigned long long)(sim_stats.cycles_isr - mark_stats.cycles_isr),
+               (unsigned long long)(sim_stats.cycles_eeprom - mark_stats.cycles_eeprom),
+               (unsigned long long)(sim_stats.cycles_flash - mark_stats.cycles_flash),
+               (unsigned long long)(sim_i2c_bytes() - mark_i2c), (sim_i2c_bus_ns() - mark_bus_ns) / 1e9);
+    }
+    mark_stats = sim_stats;
+    mark_ns = sim_now_ns;
+    mark_i2c = sim_i2c_bytes();
+    mark_bus_ns = sim_i2c_bus_ns();
+}
+
+static void expect_check(void) {
+    char got[17];
+    uint8_t i = expect_next++;
+    if (expects[i].kind == 'A') {
+        uint32_t notes = sim_buzzer_notes() - expect_notes;
+        expect_notes += notes;
+        if (notes == expects[i].notes) return;
+        snprintf(got, sizeof(got), "%u notes", notes);
+    } else {
+        uint8_t n = strlen(expects[i].text);
+        sim_ssd1306_text(expects[i].col, expects[i].page, expects[i].kind == 'E', got, n);
+        if (strcmp(got, expects[i].text) == 0) return;
+    }
+    expect_failed++;
+    printf("expect:      FAILED at ");
+    print_duration(stdout, sim_now_ns);
+    if (expects[i].kind == 'A') printf(": %u notes expected, %s\n", expects[i].notes, got);
+    else printf(": \"%s\" expected at %u,%u, \"%s\" displayed\n", expects[i].text, expects[i].col, expects[i].page, got);
+}
+
+static uint64_t next_event_ns(void) {
+    uint64_t next = next_button_edge(sim_now_ns);
+    if (mark_next < mark_count && marks[mark_next].at_ns < next) next = marks[mark_next].at_ns;
+    if (expect_next < expect_count && expects[expect_next].at_ns < next) next = expects[expect_next].at_ns;
+    if (frame_dir != NULL && next_frame_ns < next) next = next_frame_ns;
+    if (end_ns < next) next = end_ns;
+    uint64_t wdt = wdt_period();
+    if (wdt > 0 && wdt_start + wdt < next) next = wdt_start + wdt;
+    if (sim_dock_next_ns() < next) next = sim_dock_next_ns();
+    return next;
+}
+
+static uint64_t next_ev = 0;    /* cached next_event_ns() */
+
+static uint8_t powered_changed(void) {
+    return ((io[SIM_IO_DDRB] & io[SIM_IO_PORTB] & (1 << PB3)) ? 1 : 0) != devices_powered;
+}
+
+/* check time-based events: button edges, device supply, reader in the dock, frame dumps, profile marks,
+ * end of simulation */
+static void check_events(void) {
+    uint8_t level = button_level(sim_now_ns);
+    if (level != pin_button) {
+        pin_button = level;
+        if ((io[SIM_IO_GIMSK] & (1 << PCIE)) && (io[SIM_IO_PCMSK] & (1 << PB1))) {
+            io[SIM_IO_GIFR] |= (1 << PCIE);    /* GIFR: PCIF */
+        }
+    }
+    uint8_t powered = (io[SIM_IO_DDRB] & io[SIM_IO_PORTB] & (1 << PB3)) ? 1 : 0;
+    if (powered != devices_powered) {
+        devices_powered = powered;
+        sim_ssd1306_power(powered);
+        sim_scd4x_power(powered);
+    }
+    uint64_t wdt = wdt_period();
+    if (wdt > 0 && sim_now_ns >= wdt_start + wdt) {
+        wdt_start += wdt;
+        if (io[SIM_IO_WDTCR] & (1 << WDIE)) io[SIM_IO_WDTCR] |= (1 << WDIF);
+        else {
+            /* reset mode: the firmware hung */
+            wdt_reset_ns = sim_now_ns;
+            finish();
+        }
+    }
+    if (sim_now_ns >= sim_dock_next_ns()) {
+        /* the reader looks at the bus lines and drives them */
+        sim_usi_sync(io);
+        sim_dock_step();
+        sim_usi_sync(io);
+    }
+    if (frame_dir != NULL && sim_now_ns >= next_frame_ns) {
+        dump_frame();
+        next_frame_ns += frame_interval_ns;
+    }
+    while (mark_next < mark_count && sim_now_ns >= marks[mark_next].at_ns) profile_mark();
+    while (expect_next < expect_count && sim_now_ns >= expects[expect_next].at_ns) expect_check();
+    if (sim_now_ns >= end_ns) finish();
+    next_ev = next_event_ns();
+}
+
+static void advance(uint64_t n, uint8_t active);
+
+static void dispatch(void (*vector)(void)) {
+    uint64_t before = sim_stats.cycles_active;
+    in_isr = 1;
+    dispatched = 1;
+    vector();
+    advance(SIM_CYCLES_ISR, 1);
+    in_isr = 0;
+    sim_stats.cycles_isr += sim_stats.cycles_active - before;
+    if (sleeping) {
+        sleeping = 0;
+        sim_stats.wakeups++;
+    }
+}
+
+/* dispatch pending interrupts (in order of vector priority) */
+static void irq_poll(void) {
+    tifr_sync();
+    while (!in_isr && (io[SIM_IO_SREG] & 0x80)) {
+        if ((io[SIM_IO_GIFR] & (1 << PCIE)) && (io[SIM_IO_GIMSK] & (1 << PCIE))) {
+            io[SIM_IO_GIFR] &= ~(1 << PCIE);
+            sim_stats.isr_pcint0++;
+            dispatch(PCINT0_vect);
+        } else if ((io[SIM_IO_TIFR] & (1 << TOV1)) && (io[SIM_IO_TIMSK] & (1 << TOIE1))) {
+            io[SIM_IO_TIFR] &= ~(1 << TOV1);
+            sim_stats.isr_timer1++;
+            dispatch(TIM1_OVF_vect);
+        } else if ((io[SIM_IO_TIFR] & (1 << OCF0A)) && (io[SIM_IO_TIMSK] & (1 << OCIE0A))) {
+            io[SIM_IO_TIFR] &= ~(1 << OCF0A);
+            sim_stats.isr_timer0++;
+            dispatch(TIM0_COMPA_vect);
+        } else if ((io[SIM_IO_TIFR] & (1 << OCF0B)) && (io[SIM_IO_TIMSK] & (1 << OCIE0B))) {
+            io[SIM_IO_TIFR] &= ~(1 << OCF0B);
+            sim_stats.isr_timer0b++;
+            dispatch(TIM0_COMPB_vect);
+        } else if ((io[SIM_IO_WDTCR] & (1 << WDIF)) && (io[SIM_IO_WDTCR] & (1 << WDIE))) {
+            io[SIM_IO_WDTCR] &= ~(1 << WDIF);
+            sim_stats.isr_wdt++;
+            dispatch(WDT_vect);
+        } else if ((io[SIM_IO_USISR] & (1 << USISIF)) && (io[SIM_IO_USICR] & (1 << USISIE))) {
+            /* the USI flags are only cleared by the handler */
+            sim_stats.isr_usi++;
+            dispatch(USI_START_vect);
+        } else if ((io[SIM_IO_USISR] & (1 << USIOIF)) && (io[SIM_IO_USICR] & (1 << USIOIE))) {
+            sim_stats.isr_usi++;
+            dispatch(USI_OVF_vect);
+        } else {
+            break;
+        }
+    }
+}
+
+/* advance the virtual clock by n CPU cycles (active) or until the next event (sleep) */
+static void advance(uint64_t n, uint8_t active) {
+    if (active && n < quiet) {
+        /* fast path: nothing can happen within the next n cycles */
+        quiet -= n;
+        t0_acc += n;
+        t1_acc += n;
+        sim_now_ns += n * npc;
+        sim_stats.cycles_active += n;
+        sim_stats.ns_active += n * npc;
+        return;
+    }
+    quiet = 0;  /* until recomputed below: interrupt handlers run from within the loop */
+    sim_usi_sync(io);
+    tifr_sync();
+    while (n > 0) {
+        if (!(io[SIM_IO_CLKPR] & (1 << CLKPCE))) clkps = io[SIM_IO_CLKPR] & 0x0F;
+        if ((io[SIM_IO_WDTCR] & ~(1 << WDIF)) != wdt_seen) {
+            /* watchdog (re)configured: a new period starts */
+            wdt_seen = io[SIM_IO_WDTCR] & ~(1 << WDIF);
+            wdt_start = sim_now_ns;
+            next_ev = next_event_ns();
+        }
+        npc = ns_per_cycle();
+        /* a prescaler change keeps the counter value (not the cycles since the last match) */
+        uint16_t pre = timer0_prescaler();
+        if (pre != t0_pre) {
+            if (pre > 0 && t0_pre > 0) t0_acc = t0_acc * pre / t0_pre;
+            t0_pre = pre;
+        }
+        pre = (io[SIM_IO_TCCR1] & 0x0F) ? 1 << ((io[SIM_IO_TCCR1] & 0x0F) - 1) : 0;
+        if (pre != t1_pre) {
+            if (pre > 0 && t1_pre > 0) t1_acc = t1_acc * pre / t1_pre;
+            t1_pre = pre;
+        }
+        if (io[SIM_IO_TCNT0] != t0_seen) {
+            /* TCNT0 written: the prescaler keeps running */
+            t0_seen = io[SIM_IO_TCNT0];
+            if (t0_pre > 0) t0_acc = (uint64_t)t0_seen * t0_pre + t0_acc % t0_pre;
+        }
+        if (io[SIM_IO_GTCCR] & (1 << PSR0)) {
+            /* prescaler reset (the bit clears itself) */
+            io[SIM_IO_GTCCR] &= ~(1 << PSR0);
+            if (t0_pre > 0) t0_acc -= t0_acc % t0_pre;
+        }
+        uint64_t step = n;
+        uint64_t period = timer0_period();
+        if (period > 0 && t0_acc >= period) t0_acc = period - 1;    /* TOP was lowered below the counter */
+        if (period > 0 && period - t0_acc < step) step = period - t0_acc;
+        uint64_t match_a = timer0_match(SIM_IO_OCR0A, OCIE0A, period);
+        uint64_t match_b = timer0_match(SIM_IO_OCR0B, OCIE0B, period);
+        if (t0_acc < match_a && match_a - t0_acc < step) step = match_a - t0_acc;
+        if (t0_acc < match_b && match_b - t0_acc < step) step = match_b - t0_acc;
+        uint64_t period1 = timer1_period();
+        if (period1 > 0 && t1_acc >= period1) t1_acc = period1 - 1;  /* TOP was lowered below the counter */
+        if (period1 > 0 && period1 - t1_acc < step) step = period1 - t1_acc;
+        uint64_t to_ev = (next_ev - sim_now_ns + npc - 1) / npc;
+        if (to_ev == 0) to_ev = 1;
+        if (to_ev < step) step = to_ev;
+
+        sim_now_ns += step * npc;
+        if (active) {
+            sim_stats.cycles_active += step;
+            sim_stats.ns_active += step * npc;
+        } else {
+            sim_stats.ns_idle += step * npc;
+            sim_stats.cycles_idle += step;
+        }
+        n -= step;
+        if (period > 0) {
+            if (t0_acc < match_a && t0_acc + step >= match_a) io[SIM_IO_TIFR] |= (1 << OCF0A);
+            if (t0_acc < match_b && t0_acc + step >= match_b) io[SIM_IO_TIFR] |= (1 << OCF0B);
+            t0_acc += step;
+            if (t0_acc >= period) {
+                /* CTC: the counter is cleared by the compare A match */
+                t0_acc = 0;
+                io[SIM_IO_TIFR] |= (io[SIM_IO_TCCR0A] & (1 << WGM01)) ? (1 << OCF0A) : (1 << TOV0);
+            }
+        } else {
+            t0_acc = 0;
+        }
+        if (period1 > 0) {
+            t1_acc += step;
+            if (t1_acc >= period1) {
+                t1_acc = 0;
+                io[SIM_IO_TIFR] |= (1 << TOV1);
+                sim_buzzer_period(period1 * npc, (io[SIM_IO_GTCCR] & (1 << COM1B1)) ? (uint64_t)t1_pre * io[SIM_IO_OCR1B] * npc : 0);
+            }
+        } else {
+            t1_acc = 0;
+        }
+        if (sim_now_ns >= next_ev || powered_changed()) check_events();
+        irq_poll();
+        /* cycles until the next timer match or event, valid until a register gets accessed
+         * (an interrupt handler may just have reprogrammed the timers) */
+        period = timer0_period();
+        match_a = timer0_match(SIM_IO_OCR0A, OCIE0A, period);
+        match_b = timer0_match(SIM_IO_OCR0B, OCIE0B, period);
+        period1 = timer1_period();
+        quiet = (next_ev - sim_now_ns) / npc;
+        if (period > 0 && period - t0_acc < quiet) quiet = period - t0_acc;
+        if (t0_acc < match_a && match_a - t0_acc < quiet) quiet = match_a - t0_acc;
+        if (t0_acc < match_b && match_b - t0_acc < quiet) quiet = match_b - t0_acc;
+        if (period1 > 0 && period1 - t1_acc < quiet) quiet = period1 - t1_acc;
+        if (!active && !sleeping) return;   /* woken up by an interrupt */
+    }
+}
+
+void sim_cycles(uint32_t n) {
+    sei_wake = 0;
+    advance(n, 1);
+}
+
+void sim_delay_cycles(uint64_t n) {
+    sim_stats.cycles_delay += n;
+    advance(n, 1);
+}
+
+void sim_flash_read(uint32_t cycles) {
+    sim_stats.cycles_flash += cycles;
+    sim_cycles(cycles);
+}
+
+volatile uint8_t *sim_io(uint8_t addr) {
+    sei_wake = 0;
+    advance(SIM_CYCLES_IO, 1);
+    if (addr != SIM_IO_PINB) quiet = 0;     /* the access might change timers, clock or supply */
+    switch (addr) {
+        case SIM_IO_PINB:
+            sim_usi_sync(io);
+            io[SIM_IO_PINB] = (io[SIM_IO_PORTB] & io[SIM_IO_DDRB] & ~((1 << PB0) | (1 << PB2))) |
+                              sim_usi_pins() | (pin_button << PB1);
+            break;
+        case SIM_IO_TCNT0:
+            if (t0_pre > 0) io[SIM_IO_TCNT0] = t0_seen = t0_acc / t0_pre;
+            break;
+        case SIM_IO_TIFR:
+            tifr_seen = io[SIM_IO_TIFR];
+            tifr_access = 1;
+            break;
+        case SIM_IO_ADCSRA:
+            if ((io[SIM_IO_ADCSRA] & (1 << ADEN)) && (io[SIM_IO_ADCSRA] & (1 << ADSC))) {
+                /* single conversion: 25 ADC clocks (first conversion), 1.1V bandgap against VCC */
+                uint8_t ps = io[SIM_IO_ADCSRA] & 0x07;
+                advance(25 << (ps == 0 ? 1 : ps), 1);
+                uint16_t adc = (uint16_t)(1.1 * 1024.0 / vcc);
+                if (adc > 1023) adc = 1023;
+                io[SIM_IO_ADCL] = adc & 0xFF;
+                io[SIM_IO_ADCH] = adc >> 8;
+                io[SIM_IO_ADCSRA] = (io[SIM_IO_ADCSRA] & ~(1 << ADSC)) | (1 << ADIF);
+            }
+            break;
+        default:
+            break;
+    }
+    return &io[addr];
+}
+
+void sim_cli(void) {
+    io[SIM_IO_SREG] &= ~0x80;
+    advance(SIM_CYCLES_IRQ_FLAG, 1);
+}
+
+void sim_sei(void) {
+    io[SIM_IO_SREG] |= 0x80;
+    advance(SIM_CYCLES_IRQ_FLAG, 1);
+    dispatched = 0;
+    irq_poll();
+    /* the instruction after sei is executed before a pending interrupt: for
+     * "sei; sleep" that interrupt wakes the CPU again right away */
+    sei_wake = dispatched;
+}
+
+/* wdr: the watchdog period starts over */
+void sim_wdr(void) {
+    sim_cycles(1);
+    wdt_start = sim_now_ns;
+    next_ev = next_event_ns();
+}
+
+void sim_set_sleep_mode(uint8_t mode) {
+    io[SIM_IO_MCUCR] = (io[SIM_IO_MCUCR] & ~((1 << SM0) | (1 << SM1))) | mode;
+}
+
+void sim_sleep(void) {
+    if (!(io[SIM_IO_MCUCR] & (1 << SE))) return;
+    if (sei_wake) {
+        sei_wake = 0;
+        sim_stats.wakeups++;
+        return;
+    }
+    uint8_t mode = io[SIM_IO_MCUCR] & ((1 << SM0) | (1 << SM1));
+    sleeping = mode + 1;
+    if (mode == SLEEP_MODE_PWR_DOWN) {
+        /* all clocks stopped: only a pin change (button) can wake us up */
+        while (sleeping) {
+            uint64_t ev = next_event_ns();
+            sim_stats.ns_powerdown += ev - sim_now_ns;
+            if (wdt_period() > 0) sim_stats.ns_powerdown_wdt += ev - sim_now_ns;
+            sim_now_ns = ev;
+            check_events();
+            irq_poll();
+        }
+    } else {
+        while (sleeping) advance(UINT64_MAX, 0);
+    }
+}
+
+/* EEPROM: reads are cheap, writes take 3.4ms (the next access waits for completion) */
+static void eeprom_wait(void) {
+    while (sim_now_ns < eeprom_busy_until) {
+        sim_delay_cycles((eeprom_busy_until - sim_now_ns + ns_per_cycle() - 1) / ns_per_cycle());
+    }
+}
+
+void eeprom_busy_wait(void) {
+    eeprom_wait();
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p) {
+    eeprom_wait();
+    sim_stats.cycles_eeprom += SIM_CYCLES_EEPROM_READ;
+    advance(SIM_CYCLES_EEPROM_READ, 1);
+    return *p;
+}
+
+uint16_t eeprom_read_word(const uint16_t *p) {
+    const uint8_t *b = (const uint8_t *)p;
+    return eeprom_read_byte(b) | (eeprom_read_byte(b + 1) << 8);
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+    eeprom_wait();
+    sim_stats.cycles_eeprom += SIM_CYCLES_EEPROM_READ + n * SIM_CYCLES_EEPROM_BLOCK;
+    advance(SIM_CYCLES_EEPROM_READ + n * SIM_CYCLES_EEPROM_BLOCK, 1);
+    memcpy(dst, src, n);
+}
+
+void eeprom_write_byte(uint8_t *p, uint8_t value) {
+    eeprom_wait();
+    *p = value;
+    eeprom_busy_until = sim_now_ns + EEPROM_WRITE_NS;
+    sim_stats.eeprom_writes++;
+}
+
+void eeprom_update_byte(uint8_t *p, uint8_t value) {
+    if (eeprom_read_byte(p) != value) eeprom_write_byte(p, value);
+}
+
+void eeprom_update_word(uint16_t *p, uint16_t value) {
+    eeprom_update_byte((uint8_t *)p, value & 0xFF);
+    eeprom_update_byte((uint8_t *)p + 1, value >> 8);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+    for (size_t i = 0; i < n; i++) eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+}
+
+static void print_duration(FILE *f, uint64_t ns) {
+    uint64_t s = ns / 1000000000ULL;
+    fprintf(f, "%u:%02u:%02u.%03u", (unsigned)(s / 3600), (unsigned)(s / 60 % 60), (unsigned)(s % 60),
+            (unsigned)(ns / 1000000 % 1000));
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * (double)part / (double)total : 0.0;
+}
+
+/* records of the data logger, oldest first */
+static void dump_log(FILE *f) {
+#ifdef LOGGER
+    logger_record_t r;
+    unsigned n = 0;
+    logger_rewind();
+    while (logger_read(&r) == 0) {
+        fprintf(f, "  %4u  %5u ppm %5.1f C %3u %%RH%s%s\n", n++, r.co2, r.temp / 10.0, r.humidity,
+                (r.flags & LOGGER_FLAG_SESSION) ? "  (power-on)" : "", (r.flags & LOGGER_FLAG_GAP) ? "  (gap)" : "");
+    }
+    fprintf(f, "logger:      %u records in %u bytes (%.1f bits per record)\n", n, LOGGER_BLOCKS * LOGGER_BLOCK_SIZE,
+            n ? LOGGER_BLOCKS * LOGGER_BLOCK_SIZE * 8.0 / n : 0.0);
+#else
+    fprintf(f, "logger:      not built (-DLOGGER=OFF)\n");
+#endif
+}
+
+static void finish(void) {
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall = (double)(wall_end.tv_sec - wall_start.tv_sec) + (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9;
+    end_ns = UINT64_MAX;    /* dump_log() reads the EEPROM, which advances the clock */
+
+    printf("simulated:   ");
+    print_duration(stdout, sim_now_ns);
+    printf(" in %.2fs (%.0fx real time)\n", wall, wall > 0 ? sim_now_ns / 1e9 / wall : 0.0);
+    printf("cpu:         %llu cycles active (%.2f%% of time), %.2f%% in ISRs, %.2f%% in delay loops\n",
+           (unsigned long long)sim_stats.cycles_active, percent(sim_stats.ns_active, sim_now_ns),
+           percent(sim_stats.cycles_isr, sim_stats.cycles_active),
+           percent(sim_stats.cycles_delay, sim_stats.cycles_active));
+    printf("sleep:       %.2f%% idle, %.2f%% power-down, %u wakeups\n",
+           percent(sim_stats.ns_idle, sim_now_ns), percent(sim_stats.ns_powerdown, sim_now_ns), sim_stats.wakeups);
+    printf("interrupts:  %u TIM0_COMPA, %u TIM0_COMPB, %u TIM1_OVF, %u PCINT0, %u WDT, %u USI\n", sim_stats.isr_timer0,
+           sim_stats.isr_timer0b, sim_stats.isr_timer1, sim_stats.isr_pcint0, sim_stats.isr_wdt, sim_stats.isr_usi);
+    /* charge in mA*s: active/idle current scales with the clock, i.e. is a charge per cycle */
+    double charge = (sim_stats.cycles_active * SIM_MA_PER_MHZ_ACTIVE + sim_stats.cycles_idle * SIM_MA_PER_MHZ_IDLE) / 1e6
+                    + (sim_stats.ns_powerdown_wdt * SIM_UA_POWERDOWN_WDT
+                       + (sim_stats.ns_powerdown - sim_stats.ns_powerdown_wdt) * SIM_UA_POWERDOWN) / 1e12;
+    printf("mcu current: %.3f mA average (estimate at 3V)\n", sim_now_ns > 0 ? charge / (sim_now_ns / 1e9) : 0.0);
+    printf("eeprom:      %u bytes written\n", sim_stats.eeprom_writes);
+    sim_i2c_report(stdout);
+    sim_scd4x_report(stdout);
+    sim_ssd1306_report(stdout);
+    sim_dock_report(stdout);
+    if (wdt_reset_ns > 0) printf("watchdog:    reset at %.3fs (firmware hung, simulation stopped)\n", wdt_reset_ns / 1e9);
+    if (expect_count > 0) {
+        printf("expect:      %u of %u met", expect_count - expect_failed - (expect_count - expect_next), expect_count);
+        if (expect_next < expect_count) printf(", %u after the end of the simulation", expect_count - expect_next);
+        printf("\n");
+    }
+
+    if (final_pbm != NULL) sim_ssd1306_dump_pbm(final_pbm);
+    if (final_ascii) sim_ssd1306_dump_ascii(stdout);
+    if (final_log) dump_log(stdout);
+    sim_buzzer_close();
+    fflush(stdout);
+    exit(wdt_reset_ns > 0 || expect_failed > 0 || expect_next < expect_count ? 1 : 0);
+}
+
+static uint64_t parse_duration(const char *s) {
+    char *end;
+    double v = strtod(s, &end);
+    if (end[0] == 'm' && end[1] == 's') v /= 1000;
+    else if (end[0] == 'm') v *= 60;
+    else if (end[0] == 'h') v *= 3600;
+    return (uint64_t)(v * 1e9);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t DURATION  simulated run time, e.g. 90s, 30m, 8h (default: 8h)\n"
+            "  -p FILE      CO2 profile: lines of \"<seconds> <ppm> [<temp C> [<RH %%>]]\"\n"
+            "  -n           no sensor noise: the measurements are the exact profile values\n"
+            "  -b T[:LEN]   press the button at time T for LEN (default: 100ms), repeatable\n"
+            "  -v VOLTS     battery voltage (default: 3.30)\n"
+            "  -s TYPE      sensor type: 40 (SCD40) or 41 (SCD41, default)\n"
+            "  -f DIR       dump the display as PBM image into DIR every -i interval\n"
+            "  -i DURATION  frame dump interval (default: 60s)\n"
+            "  -o FILE      dump the final display content as PBM image\n"
+            "  -a           print the final display content as ASCII art\n"
+            "  -L           print the data logger records at the end\n"
+            "  -w FILE      record the sound transducer as WAV file (pauses shortened to 0.5s)\n"
+            "  -D T[:N]     put the device into the dock at time T (switch it off before): read\n"
+            "               the registers and the log over I2C, set the interval to N\n"
+            "  -H T[:N]     the sensor hangs at time T (no new data) until recovery N: 1 stop\n"
+            "               periodic measurement, 2 reinit, 3 power cycle (default)\n"
+            "  -F T[:N]     as -H, but the sensor repeats the last values\n"
+            "  -C T[:DEV[:LEN]]\n"
+            "               the cable to DEV (display, default, or sensor) breaks at time T,\n"
+            "               for LEN (default: for good)\n"
+            "  -e T:X:Y:TEXT\n"
+            "               expect TEXT on the display at time T, from text column X (0..15)\n"
+            "               of row Y (0..7); -E: double size text; the exit code is 1 if an\n"
+            "               expectation isn't met (also when it's after the end), in time order\n"
+            "  -A T:N       expect N notes (every tone of a melody) from the buzzer since the\n"
+            "               previous -A (or the start)\n"
+            "  -m T[:NAME]  profile mark: print the cycles and I2C bytes since the previous mark\n"
+            "               as NAME (without NAME, only start the next section), in time order\n"
+            "  -l           log I2C transactions to stderr\n"
+            "  -B           run the I2C benchmark instead of the firmware\n",
+            prog);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:nb:v:s:f:i:o:aLw:D:H:F:C:e:E:A:m:lB")) != -1) {
+        switch (opt) {
+            case 't': end_ns = parse_duration(optarg); break;
+            case 'p':
+                if (sim_scd4x_load_profile(optarg) != 0) {
+                    fprintf(stderr, "cannot read profile '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'n': sim_scd4x_set_noise(0); break;
+            case 'b': {
+                if (button_count >= MAX_BUTTON_EVENTS) usage(argv[0]);
+                char *sep = strchr(optarg, ':');
+                buttons[button_count].at_ns = parse_duration(optarg);
+                buttons[button_count].len_ns = sep ? parse_duration(sep + 1) : 100000000ULL;
+                button_count++;
+                break;
+            }
+            case 'v': vcc = atof(optarg); break;
+            case 's':
+                if (strcmp(optarg, "40") != 0 && strcmp(optarg, "41") != 0) usage(argv[0]);
+                sim_scd4x_set_type(optarg[1] == '1');
+                break;
+            case 'f': frame_dir = optarg; break;
+            case 'i': frame_interval_ns = parse_duration(optarg); break;
+            case 'o': final_pbm = optarg; break;
+            case 'a': final_ascii = 1; break;
+            case 'L': final_log = 1; break;
+            case 'w':
+                if (sim_buzzer_open(optarg) != 0) {
+                    fprintf(stderr, "cannot write '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D': {
+                char *sep = strchr(optarg, ':');
+                sim_dock_at(parse_duration(optarg), sep ? atoi(sep + 1) : -1);
+                break;
+            }
+            case 'H':
+            case 'F': {
+                char *sep = strchr(optarg, ':');
+                sim_scd4x_hang(parse_duration(optarg), opt == 'F', sep ? atoi(sep + 1) : 3);
+                break;
+            }
+            case 'C': {
+                char *sep = strchr(optarg, ':'), *len = sep ? strchr(sep + 1, ':') : NULL;
+                if (len != NULL) *len++ = '\0';
+                if (sep != NULL && strcmp(sep + 1, "sensor") != 0 && strcmp(sep + 1, "display") != 0) usage(argv[0]);
+                sim_i2c_cut(parse_duration(optarg), len ? parse_duration(len) : 0, sep != NULL && strcmp(sep + 1, "sensor") == 0);
+                break;
+            }
+            case 'm': {
+                char *sep = strchr(optarg, ':');
+                if (mark_count >= MAX_MARKS) usage(argv[0]);
+                marks[mark_count].at_ns = parse_duration(optarg);
+                marks[mark_count].name = sep ? sep + 1 : NULL;
+                if (mark_count > 0 && marks[mark_count].at_ns < marks[mark_count - 1].at_ns) usage(argv[0]);
+                mark_count++;
+                break;
+            }
+            case 'e':
+            case 'E':
+            case 'A': {
+                char *sep = strchr(optarg, ':');
+                if (expect_count >= MAX_EXPECTS || sep == NULL) usage(argv[0]);
+                expects[expect_count].at_ns = parse_duration(optarg);
+                expects[expect_count].kind = opt;
+                if (opt == 'A') {
+                    expects[expect_count].notes = atoi(sep + 1);
+                } else {
+                    char *y = strchr(sep + 1, ':'), *text = y ? strchr(y + 1, ':') : NULL;
+                    if (text == NULL || strlen(text + 1) > 16) usage(argv[0]);
+                    expects[expect_count].col = atoi(sep + 1);
+                    expects[expect_count].page = atoi(y + 1);
+                    expects[expect_count].text = text + 1;
+                }
+                if (expect_count > 0 && expects[expect_count].at_ns < expects[expect_count - 1].at_ns) usage(argv[0]);
+                expect_count++;
+                break;
+            }
+            case 'l': sim_log = stderr; break;
+            case 'B': bench = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (frame_interval_ns == 0) frame_interval_ns = 1;
+
+    /* reset state: CKDIV8 fuse selects the clock matching F_CPU, all pins are inputs */
+    for (clkps = 0; (8000000UL >> clkps) > F_CPU; clkps++);
+    io[SIM_IO_CLKPR] = clkps;
+    io[SIM_IO_PINB] = 0x3F;
+    sim_i2c_reset();
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    if (bench) {
+        sim_bench(stdout);
+        return 0;
+    }
+    firmware_main();
+    finish();
+    return 0;
+}
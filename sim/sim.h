@@ -0,0 +1,149 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: virtual ATtiny85 core (clock, I/O registers, interrupts)
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* I/O addresses (see ATtiny85 datasheet, "Register Summary") */
+#define SIM_IO_ADCSRB 0x03
+#define SIM_IO_ADCL   0x04
+#define SIM_IO_ADCH   0x05
+#define SIM_IO_ADCSRA 0x06
+#define SIM_IO_ADMUX  0x07
+#define SIM_IO_USICR  0x0D
+#define SIM_IO_USISR  0x0E
+#define SIM_IO_USIDR  0x0F
+#define SIM_IO_USIBR  0x10
+#define SIM_IO_PCMSK  0x15
+#define SIM_IO_PINB   0x16
+#define SIM_IO_DDRB   0x17
+#define SIM_IO_PORTB  0x18
+#define SIM_IO_EECR   0x1C
+#define SIM_IO_EEDR   0x1D
+#define SIM_IO_EEARL  0x1E
+#define SIM_IO_PRR    0x20
+#define SIM_IO_WDTCR  0x21
+#define SIM_IO_CLKPR  0x26
+#define SIM_IO_OCR0B  0x28
+#define SIM_IO_OCR0A  0x29
+#define SIM_IO_TCCR0A 0x2A
+#define SIM_IO_OCR1B  0x2B
+#define SIM_IO_GTCCR  0x2C
+#define SIM_IO_OCR1C  0x2D
+#define SIM_IO_OCR1A  0x2E
+#define SIM_IO_TCNT1  0x2F
+#define SIM_IO_TCCR1  0x30
+#define SIM_IO_TCNT0  0x32
+#define SIM_IO_TCCR0B 0x33
+#define SIM_IO_MCUSR  0x34
+#define SIM_IO_MCUCR  0x35
+#define SIM_IO_TIFR   0x38
+#define SIM_IO_TIMSK  0x39
+#define SIM_IO_GIFR   0x3A
+#define SIM_IO_GIMSK  0x3B
+#define SIM_IO_SREG   0x3F
+
+/* approximate cost model (CPU cycles) for code we cannot count exactly */
+#define SIM_CYCLES_IO        4  /* register access incl. surrounding C code */
+#define SIM_CYCLES_IRQ_FLAG 16  /* cli()/sei() incl. the critical section around it */
+#define SIM_CYCLES_ISR      60  /* interrupt entry/exit (prologue, epilogue, reti) */
+#define SIM_CYCLES_EEPROM_READ  20  /* eeprom_read_byte(): call, address, 4 cycles halted, return */
+#define SIM_CYCLES_EEPROM_BLOCK 12  /* eeprom_read_block() per byte, plus SIM_CYCLES_EEPROM_READ once */
+#define SIM_CYCLES_LPM           5  /* pgm_read_byte(): Z pointer and lpm */
+#define SIM_CYCLES_LPM_BLOCK     7  /* memcpy_P() per byte (lpm Z+, st X+, loop), plus SIM_CYCLES_LPM once */
+
+/* supply current estimate at 3V (ATtiny85 datasheet, "Typical Characteristics") */
+#define SIM_MA_PER_MHZ_ACTIVE  0.375    /* 1.5mA at 4MHz */
+#define SIM_MA_PER_MHZ_IDLE    0.0625   /* 0.25mA at 4MHz */
+#define SIM_UA_POWERDOWN_WDT   4.5
+#define SIM_UA_POWERDOWN       0.15
+
+typedef struct {
+    uint64_t cycles_active;     /* CPU cycles executed (including ISRs and busy-waits) */
+    uint64_t cycles_isr;        /* ... of those spent in interrupt handlers */
+    uint64_t cycles_delay;      /* ... of those spent in _delay_ms()/_delay_us()/_delay_loop_1() */
+    uint64_t cycles_eeprom;     /* ... of those spent reading the EEPROM */
+    uint64_t cycles_flash;      /* ... of those spent reading constants from flash */
+    uint64_t ns_active;         /* wall time (simulated) with CPU running */
+    uint64_t ns_idle;           /* ... in idle sleep */
+    uint64_t ns_powerdown;      /* ... in power-down sleep */
+    uint64_t ns_powerdown_wdt;  /* ... of those with the watchdog running */
+    uint64_t cycles_idle;       /* CPU clock cycles in idle sleep */
+    uint32_t isr_timer0;        /* number of TIM0_COMPA_vect calls */
+    uint32_t isr_timer0b;       /* number of TIM0_COMPB_vect calls */
+    uint32_t isr_timer1;        /* number of TIM1_OVF_vect calls */
+    uint32_t isr_pcint0;        /* number of PCINT0_vect calls */
+    uint32_t isr_wdt;           /* number of WDT_vect calls */
+    uint32_t isr_usi;           /* number of USI_START_vect and USI_OVF_vect calls */
+    uint32_t wakeups;           /* number of returns from sleep */
+    uint32_t eeprom_writes;     /* number of EEPROM bytes written */
+} sim_stats_t;
+
+extern uint64_t sim_now_ns;
+extern sim_stats_t sim_stats;
+extern FILE *sim_log;
+
+volatile uint8_t *sim_io(uint8_t addr);
+void sim_cycles(uint32_t n);
+void sim_delay_cycles(uint64_t n);
+void sim_flash_read(uint32_t cycles);
+void sim_cli(void);
+void sim_sei(void);
+void sim_wdr(void);
+void sim_set_sleep_mode(uint8_t mode);
+void sim_sleep(void);
+uint32_t sim_cpu_hz(void);
+uint8_t sim_devices_powered(void);
+uint32_t sim_seconds(void);
+
+/* virtual peripherals */
+void sim_i2c_reset(void);
+void sim_i2c_cut(uint64_t at_ns, uint64_t len_ns, uint8_t sensor);   /* len_ns 0: for good */
+void sim_i2c_report(FILE *f);
+uint64_t sim_i2c_bytes(void);
+uint64_t sim_i2c_bus_ns(void);
+void sim_i2c_bus_start(void);
+uint8_t sim_i2c_bus_address(uint8_t addr);
+uint8_t sim_i2c_bus_write(uint8_t data);
+uint8_t sim_i2c_bus_read(void);
+void sim_i2c_bus_stop(void);
+void sim_usi_sync(volatile uint8_t *io);
+uint8_t sim_usi_pins(void);
+void sim_usi_external(uint8_t scl_level, uint8_t sda_level);
+uint8_t sim_ssd1306_start(void);
+uint8_t sim_ssd1306_write(uint8_t data);
+void sim_ssd1306_stop(void);
+void sim_ssd1306_power(uint8_t on);
+int sim_ssd1306_dump_pbm(const char *path);
+void sim_ssd1306_dump_ascii(FILE *f);
+void sim_ssd1306_report(FILE *f);
+void sim_ssd1306_text(uint8_t col, uint8_t page, uint8_t dbl, char *out, uint8_t n);
+uint8_t sim_scd4x_start(uint8_t read);
+uint8_t sim_scd4x_write(uint8_t data);
+uint8_t sim_scd4x_read(void);
+void sim_scd4x_stop(void);
+void sim_scd4x_power(uint8_t on);
+int sim_scd4x_load_profile(const char *path);
+void sim_scd4x_set_type(uint8_t scd41);
+void sim_scd4x_set_noise(uint8_t on);
+void sim_scd4x_hang(uint64_t at_ns, uint8_t frozen, uint8_t recovery);
+void sim_scd4x_report(FILE *f);
+void sim_bench(FILE *f);
+int sim_buzzer_open(const char *path);
+void sim_buzzer_period(uint64_t period_ns, uint64_t high_ns);
+void sim_buzzer_close(void);
+uint32_t sim_buzzer_notes(void);
+void sim_dock_at(uint64_t at_ns, int interval);
+uint64_t sim_dock_next_ns(void);
+void sim_dock_step(void);
+void sim_dock_report(FILE *f);
+
+#endif /* !_SIM_H */
@@ -0,0 +1,221 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: virtual 128x64 SSD1306 (command parser and GDDRAM)
+ */
+
+#include <string.h>
+#include "sim.h"
+
+#define FONT_MEM
+#include "font.h"   /* the firmware font, to read text back from the display RAM */
+
+#define WIDTH  128
+#define PAGES  8
+
+static uint8_t gddram[PAGES][WIDTH];
+static uint8_t display_on = 0;
+static uint8_t contrast = 0x7F;
+static uint8_t col_start = 0, col_end = WIDTH - 1, page_start = 0, page_end = PAGES - 1;
+static uint8_t col = 0, page = 0;
+
+/* time on, and on with a low contrast (display power, see main.c) */
+#define CONTRAST_DIM 0x40
+static uint64_t since_ns, on_ns, dim_ns;
+
+/* transaction state */
+static uint8_t control_pending;     /* next byte is a control byte */
+static uint8_t data_mode;           /* D/C# of the current stream */
+static uint8_t continuation;        /* Co bit of the last control byte */
+
+/* command parser state: persists across transactions */
+static uint8_t cmd = 0;
+static uint8_t cmd_args = 0;        /* argument bytes still expected */
+static uint8_t cmd_buf[2];
+
+/* before the display state changes */
+static void account(void) {
+    if (display_on) {
+        on_ns += sim_now_ns - since_ns;
+        if (contrast < CONTRAST_DIM) dim_ns += sim_now_ns - since_ns;
+    }
+    since_ns = sim_now_ns;
+}
+
+static uint8_t command_args(uint8_t c) {
+    switch (c) {
+        case 0x21: case 0x22:                                   /* COLUMNADDR, PAGEADDR */
+            return 2;
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:  /* MEMORYMODE, SETCONTRAST, CHARGEPUMP, */
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB:             /* SETMULTIPLEX, ... */
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static void command(uint8_t c) {
+    if (cmd_args > 0) {
+        uint8_t n = command_args(cmd) - cmd_args;
+        cmd_buf[n] = c;
+        if (--cmd_args > 0) return;
+        switch (cmd) {
+            case 0x21:
+                col_start = col = cmd_buf[0] & 0x7F;
+                col_end = cmd_buf[1] & 0x7F;
+                break;
+            case 0x22:
+                page_start = page = cmd_buf[0] & 0x07;
+                page_end = cmd_buf[1] & 0x07;
+                break;
+            case 0x81:
+                account();
+                contrast = cmd_buf[0];
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+    cmd = c;
+    cmd_args = command_args(c);
+    if (c == 0xAE || c == 0xAF) account();
+    if (c == 0xAE) display_on = 0;
+    else if (c == 0xAF) display_on = 1;
+}
+
+/* horizontal addressing mode: column first, then wrap to the next page of the window */
+static void data(uint8_t d) {
+    gddram[page][col] = d;
+    if (col >= col_end) {
+        col = col_start;
+        page = page >= page_end ? page_start : page + 1;
+    } else {
+        col++;
+    }
+}
+
+void sim_ssd1306_power(uint8_t on) {
+    if (!on) {
+        /* display RAM is lost (its content is undefined after power-up, we start blank) */
+        memset(gddram, 0, sizeof(gddram));
+        account();
+        display_on = 0;
+        contrast = 0x7F;
+        cmd_args = 0;
+        col_start = col = 0;
+        col_end = WIDTH - 1;
+        page_start = page = 0;
+        page_end = PAGES - 1;
+    }
+}
+
+uint8_t sim_ssd1306_start(void) {
+    control_pending = 1;
+    return 1;
+}
+
+uint8_t sim_ssd1306_write(uint8_t b) {
+    if (control_pending) {
+        continuation = b & 0x80;
+        data_mode = b & 0x40;
+        control_pending = 0;
+        return 1;
+    }
+    if (data_mode) data(b);
+    else command(b);
+    if (continuation) control_pending = 1;
+    return 1;
+}
+
+void sim_ssd1306_stop(void) {
+}
+
+static uint8_t pixel(uint8_t x, uint8_t y) {
+    return (gddram[y / 8][x] >> (y % 8)) & 1;
+}
+
+/* column i of glyph g as the firmware sends it (8 columns: 7 of the font, spacing) */
+static uint8_t glyph_column(uint8_t g, uint8_t i) {
+    return i < sizeof(_font[0]) ? _font[g][i] : 0x00;
+}
+
+/* does the cell at (col, page) hold glyph g, in any of the styles (inverted, light, double)? */
+static uint8_t glyph_at(uint8_t g, uint8_t col, uint8_t page, uint8_t dbl) {
+    static const uint8_t doubled[16] = {0x00, 0x03, 0x0C, 0x0F, 0x30, 0x33, 0x3C, 0x3F,
+                                        0xC0, 0xC3, 0xCC, 0xCF, 0xF0, 0xF3, 0xFC, 0xFF};
+    for (uint8_t style = 0; style < 4; style++) {
+        uint8_t invert = (style & 1) ? 0xFF : 0x00, light = style & 2, i;
+        for (i = 0; i < 8; i++) {
+            uint8_t c = glyph_column(g, i) ^ invert;
+            if (!dbl) {
+                if (gddram[page][col * 8 + i] != (light ? c & 0xAA : c)) break;
+                continue;
+            }
+            uint8_t *x = &gddram[page][col * 8 + i * 2];
+            uint8_t u = doubled[c & 0x0F], l = doubled[c >> 4];
+            if (x[0] != (light ? u & 0xAA : u) || x[1] != (light ? u & 0x55 : u)) break;
+            if (x[WIDTH] != (light ? l & 0xAA : l) || x[WIDTH + 1] != (light ? l & 0x55 : l)) break;
+        }
+        if (i == 8) return 1;
+    }
+    return 0;
+}
+
+/* Read n characters back from the display RAM, starting at text column col
+ * (8 pixels) of page (as SSD1306_writeString() places them; double size: two
+ * columns and two pages per character). Unknown cells read as '?'. */
+void sim_ssd1306_text(uint8_t col, uint8_t page, uint8_t dbl, char *out, uint8_t n) {
+    uint8_t w = dbl ? 2 : 1;
+    for (uint8_t k = 0; k < n; k++, col += w) {
+        out[k] = '?';
+        if (col + w > WIDTH / 8 || page + w > PAGES) continue;
+        for (uint8_t g = 0; g < sizeof(_font) / sizeof(_font[0]); g++) {
+            if (!glyph_at(g, col, page, dbl)) continue;
+            char ch = '(' + g;
+            out[k] = ch == '@' ? ' ' : ch == ';' ? '%' : ch;
+            break;
+        }
+    }
+    out[n] = '\0';
+}
+
+void sim_ssd1306_report(FILE *f) {
+    account();
+    fprintf(f, "ssd1306:     on %.1f%% of the time (%.1f%% dimmed)\n", sim_now_ns > 0 ? on_ns * 100.0 / sim_now_ns : 0.0,
+            sim_now_ns > 0 ? dim_ns * 100.0 / sim_now_ns : 0.0);
+}
+
+int sim_ssd1306_dump_pbm(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return -1;
+    fprintf(f, "P4\n# contrast 0x%02x\n%d %d\n", contrast, WIDTH, PAGES * 8);
+    for (uint8_t y = 0; y < PAGES * 8; y++) {
+        for (uint8_t x = 0; x < WIDTH; x += 8) {
+            uint8_t b = 0;
+            for (uint8_t i = 0; i < 8; i++) b = (b << 1) | (display_on && pixel(x + i, y));
+            fputc(b, f);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+/* two pixel rows per text line, using half blocks; the RAM content while the display is off */
+void sim_ssd1306_dump_ascii(FILE *f) {
+    static const char *blocks[4] = {" ", "\xe2\x96\x80", "\xe2\x96\x84", "\xe2\x96\x88"};
+    if (!display_on) fprintf(f, "display off, RAM content:\n");
+    fprintf(f, "+");
+    for (uint8_t x = 0; x < WIDTH; x++) fprintf(f, "-");
+    fprintf(f, "+\n");
+    for (uint8_t y = 0; y < PAGES * 8; y += 2) {
+        fprintf(f, "|");
+        for (uint8_t x = 0; x < WIDTH; x++) fputs(blocks[pixel(x, y) | (pixel(x, y + 1) << 1)], f);
+        fprintf(f, "|\n");
+    }
+    fprintf(f, "+");
+    for (uint8_t x = 0; x < WIDTH; x++) fprintf(f, "-");
+    fprintf(f, "+\n");
+}
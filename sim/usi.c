@@ -0,0 +1,154 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * Host simulation: USI in two-wire mode and the I2C bus lines (PB0 SDA, PB2 SCL)
+ * Register writes are picked up lazily (before the next access or clock
+ * advance). Start/stop conditions and clocked bytes are decoded on the bus
+ * and passed to the device side in i2c.c, which answers with (N)ACK and data.
+ * For the dock mode (USI as target), an external master (dock.c) drives the
+ * lines, the counter counts both SCL edges and the USI holds SCL low after a
+ * start condition and, with USIWM0, after a counter overflow.
+ */
+
+#include <avr/io.h>
+#include "sim.h"
+
+#define SDA PB0
+#define SCL PB2
+
+static uint8_t usidr = 0, usisr = 0;    /* last seen register values */
+static uint8_t latch = 1;               /* SDA output latch of the USI */
+static uint8_t scl = 1, sda = 1;        /* bus line levels */
+static uint8_t slave_sda = 1;           /* device pulls SDA low */
+static uint8_t ext_scl = 1, ext_sda = 1;    /* external master pulls SCL/SDA low */
+
+/* device side state */
+static enum { BUS_IDLE, BUS_ADDRESS, BUS_WRITE, BUS_READ, BUS_IGNORE } mode = BUS_IDLE;
+static uint8_t bit;                     /* clock within the frame: 0..7 data, 8 (N)ACK */
+static uint8_t shift;                   /* byte received / being sent */
+static uint8_t clocked;                 /* a rising edge since the last falling edge */
+static uint8_t master_ack;              /* master acknowledged the byte read */
+
+/* counter clocked by both SCL edges (USICS1 without USICLK) */
+static void usi_edge(volatile uint8_t *io) {
+    uint8_t cr = io[SIM_IO_USICR];
+    if (!(cr & (1 << USIWM1)) || (cr & ((1 << USICS1) | (1 << USICLK))) != (1 << USICS1)) return;
+    usisr = (usisr & 0xF0) | ((usisr + 1) & 0x0F);
+    if ((usisr & 0x0F) == 0) usisr |= (1 << USIOIF);
+    io[SIM_IO_USISR] = usisr;
+}
+
+static void scl_rising(volatile uint8_t *io) {
+    uint8_t cr = io[SIM_IO_USICR];
+    if ((cr & (1 << USIWM1)) && (cr & (1 << USICS1))) {
+        usidr = (uint8_t)(usidr << 1) | sda;
+        io[SIM_IO_USIDR] = usidr;
+    }
+    usi_edge(io);
+    clocked = 1;
+    if (bit < 8) {
+        if (mode == BUS_ADDRESS || mode == BUS_WRITE) shift = (uint8_t)(shift << 1) | sda;
+    } else if (mode == BUS_READ) {
+        master_ack = !sda;
+    }
+}
+
+static void scl_falling(volatile uint8_t *io) {
+    usi_edge(io);
+    if (!clocked) return;   /* SCL pulled low after a start condition */
+    clocked = 0;
+    slave_sda = 1;
+    if (++bit == 8) {
+        if (mode == BUS_ADDRESS) {
+            if (sim_i2c_bus_address(shift)) {
+                slave_sda = 0;
+                mode = (shift & 1) ? BUS_READ : BUS_WRITE;
+                master_ack = 1;
+            } else {
+                mode = BUS_IGNORE;
+            }
+        } else if (mode == BUS_WRITE) {
+            slave_sda = !sim_i2c_bus_write(shift);
+        }
+        return;
+    }
+    if (bit == 9) {
+        bit = 0;
+        shift = 0;
+        if (mode == BUS_READ) {
+            if (master_ack) shift = sim_i2c_bus_read();
+            else mode = BUS_IGNORE;
+        }
+    }
+    if (mode == BUS_READ) slave_sda = (shift >> (7 - bit)) & 1;
+}
+
+void sim_usi_sync(volatile uint8_t *io) {
+    uint8_t wm = io[SIM_IO_USICR] & ((1 << USIWM1) | (1 << USIWM0));
+    uint8_t two_wire = wm & (1 << USIWM1);
+
+    /* register writes since the last sync */
+    if (io[SIM_IO_USIDR] != usidr) usidr = io[SIM_IO_USIDR];
+    if (io[SIM_IO_USISR] != usisr) {
+        uint8_t w = io[SIM_IO_USISR];
+        usisr = (usisr & 0xE0 & ~(w & 0xE0)) | (w & 0x0F);     /* flags are cleared by writing 1 */
+        io[SIM_IO_USISR] = usisr;
+    }
+    if (io[SIM_IO_USICR] & (1 << USITC)) {
+        /* software clock strobe: toggles the SCL port bit, counts one edge */
+        io[SIM_IO_USICR] &= ~(1 << USITC);
+        if (two_wire) io[SIM_IO_PORTB] ^= (1 << SCL);
+        usisr = (usisr & 0xF0) | ((usisr + 1) & 0x0F);
+        if ((usisr & 0x0F) == 0) usisr |= (1 << USIOIF);
+        io[SIM_IO_USISR] = usisr;
+    }
+
+    if (!scl) latch = usidr >> 7;  /* before SCL is released in this sync */
+
+    /* SCL: open drain, driven by the port bit, held low by the USI once low */
+    uint8_t ddr = io[SIM_IO_DDRB], port = io[SIM_IO_PORTB];
+    uint8_t hold = two_wire && (ddr & (1 << SCL)) &&
+                   ((usisr & (1 << USISIF)) || (wm == ((1 << USIWM1) | (1 << USIWM0)) && (usisr & (1 << USIOIF))));
+    uint8_t new_scl = !((ddr & (1 << SCL)) && !(port & (1 << SCL))) && ext_scl && !(hold && !scl);
+    if (new_scl != scl) {
+        scl = new_scl;
+        if (scl) scl_rising(io);
+        else scl_falling(io);
+    }
+
+    /* SDA: in two-wire mode the port bit and the output latch (transparent while SCL is low) */
+    if (!scl) latch = usidr >> 7;
+    uint8_t master = !((ddr & (1 << SDA)) && (!(port & (1 << SDA)) || (two_wire && !latch)));
+    uint8_t new_sda = master && slave_sda && ext_sda;
+    if (new_sda != sda) {
+        sda = new_sda;
+        if (scl && !sda) {
+            /* start condition */
+            sim_i2c_bus_start();
+            mode = BUS_ADDRESS;
+            bit = 0;
+            shift = 0;
+            clocked = 0;
+            slave_sda = 1;
+            usisr |= (1 << USISIF);
+        } else if (scl && sda) {
+            /* stop condition */
+            if (mode != BUS_IDLE) sim_i2c_bus_stop();
+            mode = BUS_IDLE;
+            usisr |= (1 << USIPF);
+        }
+        io[SIM_IO_USISR] = usisr;
+    }
+}
+
+uint8_t sim_usi_pins(void) {
+    return (sda << SDA) | (scl << SCL);
+}
+
+/* external master: 0 pulls the line low (applied by the next sim_usi_sync()) */
+void sim_usi_external(uint8_t scl_level, uint8_t sda_level) {
+    ext_scl = scl_level;
+    ext_sda = sda_level;
+}
@@ -1,31 +0,0 @@
-/*         ___    ___
- *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
- * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
- *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
- * CO₂ Sensor for Caving -- https://github.com/keppler/co2
- * Splash screen
- * Copyright (c) 2024-2025 Klaus Keppler - https://github.com/keppler/co2
- */
-
-#ifndef _SPLASH_H
-#define _SPLASH_H
-
-#include <stdint.h>
-#include <avr/eeprom.h>
-
-#define splash_width  46
-#define splash_height 24
-
-const uint8_t EEMEM splash_data[] = {
-    0xc0, 0xf8, 0xfc, 0x3c, 0x0e, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x06, 0x00, 0x00, 0x00, 0x00,
-    0xc0, 0xf0, 0xf8, 0x7c, 0x1c, 0x1e, 0x3e, 0xfe, 0xff, 0x7f, 0x1f, 0x0f, 0x07, 0x06, 0x0e, 0x1c,
-    0x7c, 0xf8, 0xf0, 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff,
-    0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3f, 0xff,
-    0xff, 0xe0, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0, 0xe0, 0xff,
-    0xff, 0x3f, 0x00, 0x00, 0x00, 0xc0, 0xc0, 0xc0, 0xc0, 0xc0, 0x80, 0x80, 0x00, 0x07, 0x0f, 0x0f,
-    0x1c, 0x1c, 0x18, 0x18, 0x18, 0x18, 0x1c, 0x1c, 0x00, 0x00, 0x00, 0x1c, 0x1c, 0x1c, 0x1d, 0x1f,
-    0x1f, 0x1f, 0x1e, 0x1c, 0x1c, 0x00, 0x00, 0x08, 0x0c, 0x1e, 0x1f, 0x1f, 0x1f, 0x1d, 0x1c, 0x1c,
-    0x1c, 0x00, 0x80, 0xc0, 0xe0, 0xf0, 0xd8, 0xcc, 0xcf, 0xc3
-};
-
-#endif /* _SPLASH_H_ */
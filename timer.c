@@ -3,54 +3,215 @@
  * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
  *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
  * CO₂ Sensor for Caving -- https://github.com/keppler/co2
- * Timer utility (count milliseconds using interrupt)
+ * Timer utility (tickless millisecond clock on timer0 and the watchdog)
  */
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 #include "timer.h"
 
-static uint64_t _millis = 0;
-#if F_CPU == 8000000
-static uint16_t _cnt = 0;
+/* Timer0 runs freely (normal mode) at the system clock / 1024: one count is
+ * 1.024ms at 1MHz, 1/8 of that at 8MHz. The counter is never written: the
+ * counts since the last fold (TCNT0 - _last) are added to the clock whenever
+ * the time is read, before the clock is switched, and at the compare A match
+ * that is kept 128 counts ahead of the last fold, so there are never 256
+ * counts between two folds. Compare B is the alarm that ends an idle sleep.
+ * Counts are kept in units of the fast clock (_frac) until they make up
+ * 1.024ms, which is 1ms plus 24us (_us). The clock is only switched while
+ * timer1 (sound) is stopped, and the prescaler restarts with it, so each count
+ * has the length of one clock. */
+#if F_CPU == 1000000 && F_CPU_FAST == 8000000
+#define CLOCK_DIV_FAST  clock_div_1
+#elif F_CPU == 1000000 && F_CPU_FAST == 4000000
+#define CLOCK_DIV_FAST  clock_div_2
+#elif F_CPU != F_CPU_FAST || (F_CPU != 1000000 && F_CPU != 8000000)
+    #error F_CPU value not supported
 #endif
+#define SHIFT_FAST      ((F_CPU == 8000000 ? 3 : 0) + TIMER_CLOCK_SHIFT)    /* log2(counts per 1.024ms) at F_CPU_FAST */
+#define TIMER0_CS       (1<<CS02 | 1<<CS00)         /* clock / 1024 */
+#define TIMER0_FOLD     128                         /* counts from a fold to the next compare A match */
 
-ISR(TIM0_COMPA_vect) {
-#if F_CPU == 1000000
-    _millis++;
-#elif F_CPU == 8000000
-    if (++_cnt >= 8) {
-        _cnt = 0;
-        _millis++;
+/* While awake, the watchdog resets the MCU if timer_sleep() isn't called for
+ * 8s: the last line of defence if anything hangs (every I2C wait is bounded,
+ * the longest legitimate stretch without sleeping is a few bus timeouts). */
+#define WDT_AWAKE       (1<<WDE | 1<<WDP3 | 1<<WDP0)
+
+static uint32_t _millis = 0;
+static uint32_t _seconds = 0;       /* _millis in whole seconds ... */
+static uint16_t _secMillis = 0;     /* ... and the rest (no division by 1000 needed) */
+static uint16_t _us = 0;            /* microseconds not yet added to _millis */
+static uint8_t _frac = 0;           /* fast clock counts not yet added to _us */
+static uint8_t _slow = 0;           /* log2(fast clock counts per count) at the current clock */
+static uint8_t _last = 0;           /* TCNT0 at the last fold */
+static uint16_t _wdtMillis = 0;     /* length of the current power-down sleep, 0 once it's over */
+
+/* not inlined: called from the fold, the watchdog interrupt and after an early wake-up */
+static void __attribute__((noinline)) _timer_ms(uint16_t ms) {
+    _millis += ms;
+    _secMillis += ms;
+    while (_secMillis >= 1000) {
+        _secMillis -= 1000;
+        _seconds++;
     }
+}
+
+/* add the counts since the last fold (interrupts disabled) */
+static void _timer_fold(void) {
+    uint8_t now = TCNT0;
+    uint16_t counts = ((uint16_t)(uint8_t)(now - _last) << _slow) + _frac;
+    uint16_t ms = counts >> SHIFT_FAST;
+
+    _last = now;
+    _frac = counts & ((1 << SHIFT_FAST) - 1);
+    _us += (ms << 4) + (ms << 3);
+    while (_us >= 1000) {
+        _us -= 1000;
+        ms++;
+    }
+    _timer_ms(ms);
+}
+
+ISR(TIM0_COMPA_vect) {
+    _timer_fold();
+    OCR0A = _last + TIMER0_FOLD;
+}
+
+/* idle sleep alarm: only wakes up the CPU */
+EMPTY_INTERRUPT(TIM0_COMPB_vect)
+
+/* woken up from power-down: timer0 was stopped, account for the sleep period */
+ISR(WDT_vect) {
+    _timer_ms(_wdtMillis);
+    _wdtMillis = 0;
+}
+
+/* switch the system clock (call with interrupts disabled, right after _timer_fold()):
+ * F_CPU if slow, else F_CPU_FAST */
+static void _timer_clock(uint8_t slow) {
+#if TIMER_CLOCK_SHIFT > 0
+    clock_prescale_set(slow ? (clock_div_t)(CLOCK_DIV_FAST + TIMER_CLOCK_SHIFT) : CLOCK_DIV_FAST);
+    GTCCR |= 1<<PSR0;
+    _slow = slow ? TIMER_CLOCK_SHIFT : 0;
 #else
-    #error F_CPU value not supported
+    (void)slow;
 #endif
 }
 
 void timer_init(void) {
-    // interrupt every 1024th clock cycle
-    // 1MHz: 1,000,000 Hz / 1024 = 976.5625 Hz = 1.024 ms
-    // 8MHz: 8,000,000 Hz / 1024 = 7812.5 Hz = 0.128 ms
-    // TCCR0x: CTC mode, set prescaler to 1024
-    TCCR0A = 1<<WGM01;
-    TCCR0B = 1<<CS02 | 1<<CS00;
-    OCR0A = 0x00;
+    /* TCCR0A keeps its reset value: normal mode */
+    TCCR0B = TIMER0_CS;
+    OCR0A = TIMER0_FOLD;
 
     // enable timer compare interrupt
     TIMSK = 1<<OCIE0A;
 
+    MCUSR = 0;  /* after a watchdog reset, WDRF keeps the watchdog on (16ms) */
+    cli();
+    _timer_clock(0);
+    sei();
+    timer_watchdog(1);
+}
+
+void timer_watchdog(uint8_t on) {
+    cli();
+    wdt_reset();
+    WDTCR = 1<<WDCE | 1<<WDE;
+    WDTCR = on ? WDT_AWAKE : 0;
     sei();
 }
 
 void timer_reset(void) {
+    cli();
+    _timer_fold();
     _millis = 0;
+    _seconds = 0;
+    _secMillis = 0;
+    _us = 0;
+    _frac = 0;
+    sei();
 }
 
 uint32_t timer_millis(void) {
-    uint64_t m;
+    uint32_t m;
     cli();
+    _timer_fold();
     m = _millis;
     sei();
     return m;
 }
+
+uint32_t timer_seconds(void) {
+    uint32_t s;
+    cli();
+    _timer_fold();
+    s = _seconds;
+    sei();
+    return s;
+}
+
+uint32_t timer_elapsed(uint32_t since) {
+    return timer_millis() - since;
+}
+
+/* Sleep until the next interrupt. If nothing is due within the next ms
+ * milliseconds, power down (timer0 stops) and let the watchdog wake us up
+ * after the longest period that fits (16ms..1s). A button press (PCINT0)
+ * ends the sleep early; as the moment isn't known, half the period is
+ * counted. Otherwise (or while timer1 is playing a sound) idle sleep, at the
+ * slow clock unless a sound is playing, with timer0 compare B as alarm one
+ * count after ms (at most 15ms).
+ * Check the wake-up conditions with interrupts disabled before calling this:
+ * sei() and sleep are atomic, so an interrupt in between can't be missed.
+ * Every call resets the watchdog. */
+void timer_sleep(uint16_t ms) {
+    uint8_t wdp = 0;
+    uint8_t sound = TCCR1 & 0x0F;   /* timer1 needs the fast clock */
+    uint8_t idle = ms < 16 || sound;
+
+    wdt_reset();
+    cli();
+    if (idle) {
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        _timer_fold();
+        if (!sound) _timer_clock(1);
+        if (ms > 15) ms = 15;
+        OCR0B = TCNT0 + 1 + (ms << (SHIFT_FAST - _slow));
+        TIFR = 1<<OCF0B;
+        TIMSK |= 1<<OCIE0B;
+    } else {
+        while (wdp < 6 && (32 << wdp) <= ms) wdp++;
+        _wdtMillis = 16 << wdp;
+
+        WDTCR = 1<<WDCE | 1<<WDE;
+        WDTCR = 1<<WDIE | wdp;
+        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    }
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    cli();
+    if (idle) {
+        _timer_fold();
+        if (!sound) _timer_clock(0);
+        TIMSK &= ~(1<<OCIE0B);
+    } else {
+        _timer_ms(_wdtMillis >> 1);     /* 0 unless woken up early */
+        _wdtMillis = 0;
+        WDTCR = 1<<WDCE | 1<<WDE;
+        WDTCR = WDT_AWAKE;
+    }
+    sei();
+}
+
+/* Sleep for at least ms milliseconds. Replaces _delay_ms(), which is only
+ * correct while the CPU runs at F_CPU. */
+void timer_delay(uint16_t ms) {
+    uint16_t start = timer_millis();
+    uint16_t elapsed;
+    while ((elapsed = (uint16_t)timer_millis() - start) <= ms) timer_sleep(ms - elapsed);
+}
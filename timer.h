@@ -3,7 +3,7 @@
  * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
  *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
  * CO₂ Sensor for Caving -- https://github.com/keppler/co2
- * Timer utility (count milliseconds using interrupt)
+ * Timer utility (tickless millisecond clock on timer0 and the watchdog)
  */
 
 #ifndef _TIMER_H
@@ -11,8 +11,30 @@
 
 #include <stdint.h>
 
+/* The system clock is switched at runtime (CLKPR): the CPU runs at F_CPU_FAST
+ * while it's awake and slows down to F_CPU (the clock after reset, CKDIV8 fuse)
+ * in idle sleep. Prescalers of peripherals that must keep their timing while
+ * the CPU is awake (timer1, ADC) are shifted by TIMER_CLOCK_SHIFT. */
+#ifndef F_CPU_FAST
+#define F_CPU_FAST F_CPU
+#endif
+#if F_CPU_FAST == F_CPU
+#define TIMER_CLOCK_SHIFT 0
+#elif F_CPU_FAST == 4 * F_CPU
+#define TIMER_CLOCK_SHIFT 2
+#elif F_CPU_FAST == 8 * F_CPU
+#define TIMER_CLOCK_SHIFT 3
+#else
+    #error F_CPU_FAST value not supported
+#endif
+
 void timer_init(void);
 void timer_reset(void);
 uint32_t timer_millis(void);
+uint32_t timer_elapsed(uint32_t since);    /* timer_millis() - since, also across the 32 bit wrap */
+uint32_t timer_seconds(void);              /* whole seconds of timer_millis() */
+void timer_sleep(uint16_t ms);
+void timer_delay(uint16_t ms);
+void timer_watchdog(uint8_t on);           /* watchdog reset while awake, off for the power-off sleep */
 
 #endif // _TIMER_H
@@ -0,0 +1,60 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * CO₂ trend: rate of change and time to the next alarm
+ * Every update is O(1), free of divisions and 16 bits wide (see trend.h); the
+ * state takes 22 bytes of RAM.
+ */
+
+#include "trend.h"
+
+static uint16_t _ema;                   /* smoothed CO₂ (ppm) */
+static uint16_t _ring[TREND_SLOTS];     /* _ema every TREND_SLOT seconds, _ring[_pos] is the oldest */
+static uint8_t _pos;
+static uint8_t _secs;                   /* seconds of the current slot */
+static uint8_t _shift;
+static uint8_t _started;                /* there's a first value */
+
+/* start over (the measurement restarts); shift: smoothing, see TREND_EMA_SHIFT */
+void trend_reset(uint8_t shift) {
+    _shift = shift;
+    _started = 0;
+}
+
+void trend_sample(uint16_t co2) {
+    if (!_started) {
+        /* no history yet: flat */
+        _started = 1;
+        _ema = co2;
+        for (uint8_t i = 0; i < TREND_SLOTS; i++) _ring[i] = co2;
+        _secs = 0;
+        return;
+    }
+    if (co2 > _ema) _ema += (co2 - _ema) >> _shift;
+    else _ema -= (_ema - co2) >> _shift;
+}
+
+void trend_second(void) {
+    if (!_started || ++_secs < TREND_SLOT) return;
+    _secs = 0;
+    _ring[_pos] = _ema;
+    _pos = (_pos + 1) & (TREND_SLOTS - 1);
+}
+
+int16_t trend_slope(void) {
+    return (int16_t)(_ema - _ring[_pos]) >> TREND_WINDOW_SHIFT;
+}
+
+/* by stepping through the minutes: at most TREND_ETA_MAX additions instead of a division */
+uint8_t trend_eta(uint16_t level) {
+    int16_t slope = trend_slope();
+    uint8_t minutes = 0;
+
+    if (_ema < level && slope <= 0) return TREND_ETA_NONE;
+    for (uint16_t reached = _ema; reached < level; reached += slope) {
+        if (++minutes > TREND_ETA_MAX) return TREND_ETA_NONE;
+    }
+    return minutes;
+}
@@ -0,0 +1,31 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * CO₂ trend: rate of change and time to the next alarm (build with -DTREND=ON)
+ */
+
+#ifndef _TREND_H
+#define _TREND_H
+
+#include <stdint.h>
+
+/* The measurements are smoothed (EMA, 1/2^shift of each new value); every
+ * TREND_SLOT seconds the smoothed value goes into a ring of TREND_SLOTS. The
+ * slope over the window (4 minutes) is then a subtraction and a shift. */
+#define TREND_EMA_SHIFT     2       /* smoothing at 5s intervals (slower intervals: none) */
+#define TREND_SLOT          30      /* seconds */
+#define TREND_SLOTS         8
+#define TREND_WINDOW_SHIFT  2       /* log2(TREND_SLOTS * TREND_SLOT / 60) */
+#define TREND_ETA_MAX       60      /* minutes: later crossings aren't predicted */
+#define TREND_ETA_NONE      0xFF
+#define TREND_WARN          5       /* minutes: early warning before the next alarm */
+
+void trend_reset(uint8_t shift);
+void trend_sample(uint16_t co2);
+void trend_second(void);
+int16_t trend_slope(void);          /* ppm per minute */
+uint8_t trend_eta(uint16_t level);  /* minutes until the smoothed value reaches level, or TREND_ETA_NONE */
+
+#endif /* !_TREND_H */
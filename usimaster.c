@@ -0,0 +1,144 @@
+/*         ___    ___
+ *  __ ___|_  )__/ __| ___ _ _  ___ ___ _ _
+ * / _/ _ \/ /___\__ \/ -_) ' \(_-</ _ \ '_|
+ *_\__\___/___|  |___/\___|_||_/__/\___/_|_________________________________
+ * CO₂ Sensor for Caving -- https://github.com/keppler/co2
+ * I2C master on the USI (same API as i2cmaster.S, select with -DI2C_USI=ON)
+ * Based on Atmel Application Note AVR310. The USI shifts the bits in and out
+ * and counts the clock edges; the CPU only toggles SCL with the software
+ * clock strobe and polls for the counter overflow. Waits for a device that
+ * stretches the clock are bounded as in i2cmaster.S (see i2c_timeout).
+ */
+
+#include <avr/io.h>
+#include <util/delay_basic.h>
+#include "i2cmaster.h"
+
+#define SDA PB0
+#define SCL PB2
+
+/* SCL half period in _delay_loop_1() iterations (3 cycles each), on top of
+ * about 6 cycles of loop code per half period (the bus runs at F_CPU_FAST) */
+#define T2_CYCLES(ns) (F_CPU_FAST / 1000000UL * (ns) / 1000UL)
+#define T2_LOOPS(ns) (T2_CYCLES(ns) > 6 ? (T2_CYCLES(ns) - 4) / 3 : 1)
+#define DELAY_STANDARD T2_LOOPS(4700)   /* 100 kHz: SCL low >= 4.7us */
+#define DELAY_FAST     T2_LOOPS(1300)   /* 400 kHz: SCL low >= 1.3us */
+
+/* two-wire mode, shift register clocked by SCL, counter by the USITC strobe
+ * (so each strobe toggles SCL and counts one edge) */
+#define USICR_IDLE   (_BV(USIWM1) | _BV(USICS1) | _BV(USICLK))
+#define USICR_STROBE (USICR_IDLE | _BV(USITC))
+
+/* clear all flags and preset the counter: 16 edges = 8 bits, 2 edges = 1 bit */
+#define USISR_8BIT (_BV(USISIF) | _BV(USIOIF) | _BV(USIPF) | _BV(USIDC))
+#define USISR_1BIT (USISR_8BIT | (0x0E << USICNT0))
+
+static uint8_t _delay = DELAY_FAST;
+unsigned char i2c_timeout;
+
+/* wait until SCL is high (clock stretching), at most 65536 polls, and not
+ * at all once the transaction has timed out */
+static void _i2c_scl_wait(void) {
+    uint16_t n = 0;
+    if (i2c_timeout) return;
+    while (!(PINB & _BV(SCL))) {
+        if (--n == 0) {
+            i2c_timeout = 1;
+            return;
+        }
+    }
+}
+
+/* clock out/in the bits preset in USISR; returns the shift register */
+static uint8_t _i2c_transfer(uint8_t usisr) {
+    uint8_t data;
+
+    USISR = usisr;
+    do {
+        _delay_loop_1(_delay);
+        USICR = USICR_STROBE;               /* SCL high */
+        _i2c_scl_wait();                    /* clock stretching */
+        _delay_loop_1(_delay);
+        USICR = USICR_STROBE;               /* SCL low */
+    } while (!(USISR & _BV(USIOIF)) && !i2c_timeout);
+    _delay_loop_1(_delay);
+    data = USIDR;
+    USIDR = 0xFF;                           /* release SDA */
+    DDRB |= _BV(SDA);
+    return data;
+}
+
+void i2c_init(void) {
+    PORTB |= _BV(SDA) | _BV(SCL);
+    DDRB |= _BV(SDA) | _BV(SCL);
+    USIDR = 0xFF;
+    USICR = USICR_IDLE;
+    USISR = USISR_8BIT;
+}
+
+void i2c_speed(unsigned char fast) {
+    _delay = fast ? DELAY_FAST : DELAY_STANDARD;
+}
+
+unsigned char i2c_start(unsigned char addr) {
+    /* SDA falls while SCL is high (also a repeated start: SDA is released) */
+    i2c_timeout = 0;
+    PORTB |= _BV(SCL);
+    _i2c_scl_wait();
+    _delay_loop_1(_delay);
+    PORTB &= ~_BV(SDA);
+    _delay_loop_1(_delay);
+    PORTB &= ~_BV(SCL);
+    PORTB |= _BV(SDA);                      /* SDA follows the shift register again */
+    return i2c_write(addr);
+}
+
+unsigned char i2c_rep_start(unsigned char addr) {
+    if (i2c_timeout) return 1;  /* still the same transaction */
+    return i2c_start(addr);
+}
+
+unsigned char i2c_start_wait(unsigned char addr) {
+    uint16_t tries = I2C_START_TRIES;
+    while (i2c_start(addr)) {
+        i2c_stop();
+        if (i2c_timeout || --tries == 0) return i2c_timeout = 1;
+    }
+    return 0;
+}
+
+void i2c_stop(void) {
+    PORTB &= ~_BV(SDA);
+    PORTB |= _BV(SCL);
+    _i2c_scl_wait();
+    _delay_loop_1(_delay);
+    PORTB |= _BV(SDA);
+    _delay_loop_1(_delay);
+}
+
+unsigned char i2c_write(unsigned char data) {
+    if (i2c_timeout) return 1;
+    USIDR = data;
+    _i2c_transfer(USISR_8BIT);
+    DDRB &= ~_BV(SDA);                      /* read (N)ACK */
+    return (_i2c_transfer(USISR_1BIT) & 0x01) | i2c_timeout;
+}
+
+static unsigned char _i2c_read(uint8_t ack) {
+    uint8_t data;
+
+    if (i2c_timeout) return 0xFF;
+    DDRB &= ~_BV(SDA);
+    data = _i2c_transfer(USISR_8BIT);
+    USIDR = ack ? 0x00 : 0xFF;
+    _i2c_transfer(USISR_1BIT);
+    return data;
+}
+
+unsigned char i2c_readAck(void) {
+    return _i2c_read(1);
+}
+
+unsigned char i2c_readNak(void) {
+    return _i2c_read(0);
+}